@@ -0,0 +1,292 @@
+/// \file analysiscache.cpp
+/// \brief Save and load the results of the analyses on an input binary.
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+// LLVM includes
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+// Local includes
+#include "analysiscache.h"
+#include "debug.h"
+
+using namespace llvm;
+
+static const char Magic[] = "RVMBJTS1";
+
+bool readJumpTargets(std::string Path, JumpTargetsList &Result) {
+  std::ifstream Input(Path, std::ios::binary);
+  if (!Input)
+    return false;
+
+  char Header[8];
+  uint64_t Count = 0;
+  Input.read(Header, sizeof(Header));
+  Input.read(reinterpret_cast<char *>(&Count), sizeof(Count));
+  if (!Input || memcmp(Header, Magic, sizeof(Header)) != 0)
+    return false;
+
+  Result.clear();
+  uint64_t Entry[2];
+  for (uint64_t I = 0; I < Count; I++) {
+    if (!Input.read(reinterpret_cast<char *>(Entry), sizeof(Entry)))
+      return false;
+    Result.push_back({ Entry[0], static_cast<uint32_t>(Entry[1]) });
+  }
+
+  return true;
+}
+
+bool writeJumpTargets(std::string Path, const JumpTargetsList &JumpTargets) {
+  std::ofstream Output(Path, std::ios::binary);
+  if (!Output)
+    return false;
+
+  uint64_t Count = JumpTargets.size();
+  Output.write(Magic, sizeof(Magic) - 1);
+  Output.write(reinterpret_cast<const char *>(&Count), sizeof(Count));
+  for (auto &P : JumpTargets) {
+    uint64_t Entry[2] = { P.first, P.second };
+    Output.write(reinterpret_cast<const char *>(Entry), sizeof(Entry));
+  }
+
+  return static_cast<bool>(Output);
+}
+
+AnalysisCache::AnalysisCache(std::string Directory) : Directory(Directory) {
+  if (!isEnabled())
+    return;
+
+  addToKey("revamb-analysis-cache-2");
+
+  // The results depend on the implementation of the analyses, use the content
+  // of the executable as its build identifier
+  auto BufferOrErr = MemoryBuffer::getFile("/proc/self/exe");
+  if (!BufferOrErr) {
+    dbgs() << "Couldn't read the revamb executable, disabling the analysis"
+           << " cache\n";
+    this->Directory.clear();
+    return;
+  }
+  addToKey(BufferOrErr.get()->getBuffer());
+}
+
+std::string AnalysisCache::path() {
+  if (Key.size() == 0) {
+    MD5::MD5Result Result;
+    SmallString<32> String;
+    Hash.final(Result);
+    MD5::stringifyResult(Result, String);
+    Key = String.str();
+  }
+
+  return Directory + "/" + Key + ".jts";
+}
+
+bool AnalysisCache::load() {
+  if (!isEnabled())
+    return false;
+
+  std::string Path = path();
+  if (!readJumpTargets(Path, JumpTargets)) {
+    DBG("cache", dbg << "No usable analysis cache in " << Path << "\n");
+    JumpTargets.clear();
+    return false;
+  }
+
+  DBG("cache", dbg << "Loaded " << std::dec << JumpTargets.size()
+                   << " jump targets from " << Path << "\n");
+
+  return true;
+}
+
+void AnalysisCache::store(const JumpTargetsList &JumpTargets) {
+  if (!isEnabled())
+    return;
+
+  std::string Path = path();
+  std::error_code EC = sys::fs::create_directories(Directory);
+  if (EC) {
+    dbgs() << "Couldn't create " << Directory << ": " << EC.message() << "\n";
+    return;
+  }
+
+  // Write to a temporary file and then move it in place, so that concurrent
+  // runs never see a partially written file
+  int FD;
+  SmallString<128> Temporary;
+  EC = sys::fs::createUniqueFile(Path + "-%%%%%%.tmp", FD, Temporary);
+  if (EC) {
+    dbgs() << "Couldn't create a temporary file in " << Directory << ": "
+           << EC.message() << "\n";
+    return;
+  }
+  raw_fd_ostream(FD, true).close();
+
+  if (!writeJumpTargets(Temporary.str(), JumpTargets)
+      || sys::fs::rename(Temporary, Path)) {
+    dbgs() << "Couldn't write the analysis cache " << Path << "\n";
+    sys::fs::remove(Temporary);
+    return;
+  }
+
+  DBG("cache", dbg << "Saved " << std::dec << JumpTargets.size()
+                   << " jump targets to " << Path << "\n");
+}
+
+static const char StateMagic[] = "RVMBSTA1";
+
+// FNV-1a, a stable hash function, since the hashes end up on disk
+static uint64_t hashBytes(uint64_t Hash,
+                          const uint8_t *Start,
+                          const uint8_t *End) {
+  for (const uint8_t *I = Start; I != End; I++) {
+    Hash ^= *I;
+    Hash *= 0x100000001b3ULL;
+  }
+  return Hash;
+}
+
+void TranslationState::addSegment(uint64_t Start,
+                                  uint64_t End,
+                                  ArrayRef<uint8_t> Data,
+                                  bool IsExecutable) {
+  for (uint64_t Page = Start & ~(PageSize - 1); Page < End; Page += PageSize) {
+    uint64_t From = std::max(Page, Start);
+    uint64_t To = std::min(Page + PageSize, End);
+
+    // A page might be shared by multiple segments, accumulate their hashes
+    auto It = Pages.find(Page);
+    uint64_t Hash = It != Pages.end() ? It->second : 0xcbf29ce484222325ULL;
+
+    // The boundaries and the permissions of the segment are part of the hash
+    uint64_t Header[3] = { From, To, IsExecutable };
+    auto *HeaderBytes = reinterpret_cast<const uint8_t *>(Header);
+    Hash = hashBytes(Hash, HeaderBytes, HeaderBytes + sizeof(Header));
+
+    uint64_t FileFrom = From - Start;
+    uint64_t FileTo = std::min<uint64_t>(To - Start, Data.size());
+    if (FileFrom < FileTo)
+      Hash = hashBytes(Hash, Data.data() + FileFrom, Data.data() + FileTo);
+
+    Pages[Page] = Hash;
+  }
+}
+
+TranslationState::RangesVector
+TranslationState::changedPages(const TranslationState &Other) const {
+  std::vector<uint64_t> Changed;
+  for (auto &P : Pages) {
+    auto It = Other.Pages.find(P.first);
+    if (It == Other.Pages.end() || It->second != P.second)
+      Changed.push_back(P.first);
+  }
+
+  for (auto &P : Other.Pages)
+    if (Pages.count(P.first) == 0)
+      Changed.push_back(P.first);
+
+  std::sort(Changed.begin(), Changed.end());
+
+  // Merge the adjacent pages
+  RangesVector Result;
+  for (uint64_t Page : Changed) {
+    if (!Result.empty() && Result.back().second == Page)
+      Result.back().second = Page + PageSize;
+    else
+      Result.push_back({ Page, Page + PageSize });
+  }
+
+  return Result;
+}
+
+bool TranslationState::overlaps(const RangesVector &Ranges,
+                                uint64_t Start,
+                                uint64_t End) {
+  // Find the first range ending after Start
+  using Range = std::pair<uint64_t, uint64_t>;
+  auto EndsAfter = [] (uint64_t Address, const Range &R) {
+    return Address < R.second;
+  };
+  auto It = std::upper_bound(Ranges.begin(), Ranges.end(), Start, EndsAfter);
+  return It != Ranges.end() && It->first < End;
+}
+
+template<typename T>
+static bool readPairs(std::ifstream &Input, T &Result) {
+  uint64_t Count = 0;
+  if (!Input.read(reinterpret_cast<char *>(&Count), sizeof(Count)))
+    return false;
+
+  using Pair = typename T::value_type;
+  using First = typename Pair::first_type;
+  using Second = typename Pair::second_type;
+  Result.clear();
+  uint64_t Entry[2];
+  for (uint64_t I = 0; I < Count; I++) {
+    if (!Input.read(reinterpret_cast<char *>(Entry), sizeof(Entry)))
+      return false;
+    Result.insert(Result.end(), Pair(static_cast<First>(Entry[0]),
+                                     static_cast<Second>(Entry[1])));
+  }
+
+  return true;
+}
+
+template<typename T>
+static void writePairs(std::ofstream &Output, const T &Pairs) {
+  uint64_t Count = Pairs.size();
+  Output.write(reinterpret_cast<const char *>(&Count), sizeof(Count));
+  for (auto &P : Pairs) {
+    uint64_t Entry[2] = { P.first, P.second };
+    Output.write(reinterpret_cast<const char *>(Entry), sizeof(Entry));
+  }
+}
+
+bool TranslationState::read(std::string Path) {
+  std::ifstream Input(Path, std::ios::binary);
+  if (!Input)
+    return false;
+
+  char Header[8];
+  Input.read(Header, sizeof(Header));
+  if (!Input || memcmp(Header, StateMagic, sizeof(Header)) != 0)
+    return false;
+
+  if (!readPairs(Input, Pages)
+      || !readPairs(Input, OriginalBBs)
+      || !readPairs(Input, ReadRanges)
+      || !readPairs(Input, JumpTargets))
+    return false;
+
+  DBG("cache", dbg << "Loaded the state of a previous translation from "
+                   << Path << ": " << std::dec << Pages.size() << " pages, "
+                   << OriginalBBs.size() << " basic blocks and "
+                   << JumpTargets.size() << " jump targets\n");
+
+  return true;
+}
+
+bool TranslationState::write(std::string Path) const {
+  std::ofstream Output(Path, std::ios::binary);
+  if (!Output)
+    return false;
+
+  Output.write(StateMagic, sizeof(StateMagic) - 1);
+  writePairs(Output, Pages);
+  writePairs(Output, OriginalBBs);
+  writePairs(Output, ReadRanges);
+  writePairs(Output, JumpTargets);
+
+  return static_cast<bool>(Output);
+}
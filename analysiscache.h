@@ -0,0 +1,142 @@
+#ifndef _ANALYSISCACHE_H
+#define _ANALYSISCACHE_H
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// LLVM includes
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MD5.h"
+
+/// \brief List of jump targets, along with the reasons they were registered
+///        for (a combination of JumpTargetManager::JTReason)
+using JumpTargetsList = std::vector<std::pair<uint64_t, uint32_t>>;
+
+/// \brief Load a list of jump targets from \p Path
+///
+/// The file starts with a header (the "RVMBJTS1" magic and the number of jump
+/// targets), followed by a pair of 64-bit words for each jump target, in host
+/// byte order: its address and its reasons.
+///
+/// \return true if the file has been loaded successfully.
+bool readJumpTargets(std::string Path, JumpTargetsList &Result);
+
+/// \brief Write \p JumpTargets to \p Path, in the format read by
+///        readJumpTargets
+///
+/// \return true if the file has been written successfully.
+bool writeJumpTargets(std::string Path, const JumpTargetsList &JumpTargets);
+
+/// \brief On-disk cache of the results of the analyses on an input binary
+///
+/// The results are stored in a directory, in a file named after a hash of
+/// everything affecting them: the input binary and the options relevant to
+/// the analyses, which have to be provided through addToKey, and the revamb
+/// executable itself, so that a new build never uses stale results.
+/// Currently, the cache holds the final set of jump targets.
+class AnalysisCache {
+public:
+  /// \param Directory the directory holding the cache, an empty string
+  ///        disables the cache.
+  AnalysisCache(std::string Directory);
+
+  bool isEnabled() const { return Directory.size() != 0; }
+
+  void addToKey(llvm::StringRef Data) {
+    uint64_t Size = Data.size();
+    addToKey(Size);
+    Hash.update(Data);
+  }
+
+  void addToKey(uint64_t Value) {
+    Hash.update(llvm::StringRef(reinterpret_cast<const char *>(&Value),
+                                sizeof(Value)));
+  }
+
+  /// \brief Load the results associated to the current key, if available
+  ///
+  /// No more data can be added to the key after calling this method.
+  ///
+  /// \return true if the results have been loaded.
+  bool load();
+
+  /// \brief Store \p JumpTargets as the results associated to the current key
+  void store(const JumpTargetsList &JumpTargets);
+
+  const JumpTargetsList &jumpTargets() const { return JumpTargets; }
+
+private:
+  /// \brief Return the path of the file associated to the current key,
+  ///        finalizing the key
+  std::string path();
+
+private:
+  std::string Directory;
+  llvm::MD5 Hash;
+  std::string Key;
+  JumpTargetsList JumpTargets;
+};
+
+/// \brief State of a translation, allowing to retranslate a patched version
+///        of the same binary reusing the results of the analyses
+///
+/// The state holds a hash of each page of the segments, the boundaries of
+/// the input basic blocks, the ranges of global data read by the analyses
+/// and the final set of jump targets. Comparing the hashes of the pages with
+/// the ones of the new binary tells which results are still valid.
+class TranslationState {
+public:
+  /// \brief List of right-open address ranges
+  using RangesVector = std::vector<std::pair<uint64_t, uint64_t>>;
+
+  static const uint64_t PageSize = 4096;
+
+public:
+  /// \brief Hash the pages of the segment [\p Start, \p End)
+  ///
+  /// \param Data the content of the segment available in the input file, the
+  ///        rest of the segment is zero-filled.
+  void addSegment(uint64_t Start,
+                  uint64_t End,
+                  llvm::ArrayRef<uint8_t> Data,
+                  bool IsExecutable);
+
+  /// \brief Return the pages whose content differs from the ones of \p Other,
+  ///        including the ones present in only one of the two states
+  ///
+  /// \return a sorted list of disjoint ranges.
+  RangesVector changedPages(const TranslationState &Other) const;
+
+  /// \brief Check if any range in the sorted list \p Ranges overlaps
+  ///        [\p Start, \p End)
+  static bool overlaps(const RangesVector &Ranges,
+                       uint64_t Start,
+                       uint64_t End);
+
+  /// \brief Load the state from \p Path
+  ///
+  /// \return true if the file has been loaded successfully.
+  bool read(std::string Path);
+
+  /// \brief Write the state to \p Path, in the format read by read
+  ///
+  /// \return true if the file has been written successfully.
+  bool write(std::string Path) const;
+
+public:
+  std::map<uint64_t, uint64_t> Pages; ///< Hash of each page, by address
+  RangesVector OriginalBBs; ///< Input basic blocks, sorted by address
+  RangesVector ReadRanges; ///< Global data read by the analyses
+  JumpTargetsList JumpTargets;
+};
+
+#endif // _ANALYSISCACHE_H
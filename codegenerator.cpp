@@ -7,6 +7,7 @@
 //
 
 // Standard includes
+#include <algorithm>
 #include <cstring>
 #include <memory>
 #include <sstream>
@@ -17,6 +18,7 @@
 
 // LLVM includes
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/ExecutionEngine/RuntimeDyld.h"
 #include "llvm/IR/AssemblyAnnotationWriter.h"
 #include "llvm/IR/CFG.h"
@@ -28,20 +30,29 @@
 #include "llvm/Linker/Linker.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/ELF.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_os_ostream.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
 // Local includes
+#include "analysiscache.h"
 #include "codegenerator.h"
 #include "debug.h"
 #include "debughelper.h"
 #include "functionboundariesdetection.h"
+#include "inlinecaches.h"
 #include "instructiontranslator.h"
+#include "isolatefunctions.h"
 #include "jumptargetmanager.h"
+#include "partitionmodule.h"
+#include "profile.h"
 #include "ptcinterface.h"
 #include "revamb.h"
+#include "shadowstack.h"
+#include "timereport.h"
 #include "variablemanager.h"
 
 using namespace llvm;
@@ -61,21 +72,29 @@ CodeGenerator::CodeGenerator(std::string Input,
                              Architecture& Target,
                              std::string Output,
                              std::string Helpers,
-                             DebugInfoType DebugInfo,
-                             std::string Debug,
-                             std::string LinkingInfo,
-                             std::string Coverage,
-                             std::string BBSummary,
-                             bool EnableOSRA,
-                             bool EnableTracing,
-                             bool UseSections) :
+                             const Options &Opts) :
   TargetArchitecture(Target),
   Context(getGlobalContext()),
   TheModule((new Module("top", Context))),
   OutputPath(Output),
-  Debug(new DebugHelper(Output, Debug, TheModule.get(), DebugInfo)),
-  EnableOSRA(EnableOSRA),
-  EnableTracing(EnableTracing)
+  Debug(new DebugHelper(Output, Opts.DebugPath, TheModule.get(),
+                        Opts.DebugInfo)),
+  Cache(new AnalysisCache(Opts.CacheDirectory)),
+  EnableOSRA(Opts.EnableOSRA),
+  IncrementalHarvest(Opts.IncrementalHarvest),
+  EnableTracing(Opts.EnableTracing),
+  EmitBitcode(Opts.EmitBitcode),
+  IsolateFunctions(Opts.IsolateFunctions),
+  SplitModules(Opts.SplitModules),
+  Dispatcher(Opts.Dispatcher),
+  InlineCaches(Opts.InlineCaches),
+  InlineCacheCounters(Opts.InlineCacheCounters),
+  ProfilePath(Opts.ProfilePath),
+  ShadowStack(Opts.ShadowStack),
+  JumpTargetsHintsPath(Opts.JumpTargetsHintsPath),
+  ExportJumpTargetsPath(Opts.ExportJumpTargetsPath),
+  PreviousStatePath(Opts.PreviousStatePath),
+  SaveStatePath(Opts.SaveStatePath)
 {
   OriginalInstrMDKind = Context.getMDKindID("oi");
   PTCInstrMDKind = Context.getMDKindID("pi");
@@ -89,13 +108,13 @@ CodeGenerator::CodeGenerator(std::string Input,
     abort();
   }
 
-  if (Coverage.size() == 0)
-    Coverage = Output + ".coverage.csv";
-  this->CoveragePath = Coverage;
+  CoveragePath = Opts.CoveragePath;
+  if (CoveragePath.size() == 0)
+    CoveragePath = Output + ".coverage.csv";
 
-  if (BBSummary.size() == 0)
-    BBSummary = Output + ".bbsummary.csv";
-  this->BBSummaryPath = BBSummary;
+  BBSummaryPath = Opts.BBSummaryPath;
+  if (BBSummaryPath.size() == 0)
+    BBSummaryPath = Output + ".bbsummary.csv";
 
   auto BinaryOrErr = object::createBinary(Input);
   assert(BinaryOrErr && "Couldn't open the input file");
@@ -155,19 +174,47 @@ CodeGenerator::CodeGenerator(std::string Input,
 
   if (SourceArchitecture.pointerSize() == 32) {
     if (SourceArchitecture.isLittleEndian()) {
-      parseELF<object::ELF32LE>(TheBinary, LinkingInfo, UseSections);
+      parseELF<object::ELF32LE>(TheBinary,
+                                Opts.LinkingInfoPath,
+                                Opts.UseSections);
     } else {
-      parseELF<object::ELF32BE>(TheBinary, LinkingInfo, UseSections);
+      parseELF<object::ELF32BE>(TheBinary,
+                                Opts.LinkingInfoPath,
+                                Opts.UseSections);
     }
   } else if (SourceArchitecture.pointerSize() == 64) {
     if (SourceArchitecture.isLittleEndian()) {
-      parseELF<object::ELF64LE>(TheBinary, LinkingInfo, UseSections);
+      parseELF<object::ELF64LE>(TheBinary,
+                                Opts.LinkingInfoPath,
+                                Opts.UseSections);
     } else {
-      parseELF<object::ELF64BE>(TheBinary, LinkingInfo, UseSections);
+      parseELF<object::ELF64BE>(TheBinary,
+                                Opts.LinkingInfoPath,
+                                Opts.UseSections);
     }
   } else {
     assert("Unexpect address size");
   }
+
+  // Everything affecting the results of the analyses is part of the key of
+  // the cache
+  if (Cache->isEnabled()) {
+    Cache->addToKey(TheBinary->getData());
+    Cache->addToKey(static_cast<uint64_t>(Opts.UseSections));
+    Cache->addToKey(static_cast<uint64_t>(EnableOSRA));
+    Cache->addToKey(static_cast<uint64_t>(IncrementalHarvest));
+
+    for (const std::string &Path : { ProfilePath,
+                                     JumpTargetsHintsPath,
+                                     PreviousStatePath }) {
+      if (Path.size() == 0)
+        continue;
+
+      auto BufferOrErr = MemoryBuffer::getFile(Path);
+      if (BufferOrErr)
+        Cache->addToKey(BufferOrErr.get()->getBuffer());
+    }
+  }
 }
 
 std::string SegmentInfo::generateName() {
@@ -186,6 +233,8 @@ template<typename T>
 void CodeGenerator::parseELF(object::ObjectFile *TheBinary,
                              std::string LinkingInfo,
                              bool UseSections) {
+  ScopedPhase Phase("parseELF");
+
   // Parse the ELF file
   std::error_code EC;
   object::ELFFile<T> TheELF(TheBinary->getData(), EC);
@@ -263,26 +312,25 @@ void CodeGenerator::parseELF(object::ObjectFile *TheBinary,
 
       std::string Name = Segment.generateName();
 
-      // Get data and size
-      auto *DataType = ArrayType::get(Uint8Ty, ProgramHeader.p_memsz);
-
-      Constant *TheData = nullptr;
-      if (ProgramHeader.p_memsz == ProgramHeader.p_filesz) {
-        // Create the array directly from the mmap'd ELF
-        auto FileData = ArrayRef<uint8_t>(ActualStartAddress,
-                                          ProgramHeader.p_filesz);
-        TheData = ConstantDataArray::get(Context, FileData);
+      // Keep a reference to the data in the mmap'd ELF, the initializer will
+      // be created at the end of the translation
+      uint64_t FileSize = std::min<uint64_t>(ProgramHeader.p_filesz,
+                                             ProgramHeader.p_memsz);
+      Segment.Data = ArrayRef<uint8_t>(ActualStartAddress, FileSize);
+
+      // If we have extra data at the end, the variable is a packed struct
+      // composed by the data from the file and an array of zeros
+      Type *DataType = nullptr;
+      uint64_t ZeroSize = ProgramHeader.p_memsz - FileSize;
+      if (ZeroSize == 0 || FileSize == 0) {
+        DataType = ArrayType::get(Uint8Ty, ProgramHeader.p_memsz);
       } else {
-        // If we have extra data at the end we need to create a copy of the
-        // segment and append the NULL bytes
-        auto FullData = make_unique<uint8_t[]>(ProgramHeader.p_memsz);
-        ::memcpy(FullData.get(),
-                 ActualStartAddress,
-                 ProgramHeader.p_filesz);
-        ::bzero(FullData.get() + ProgramHeader.p_filesz,
-                ProgramHeader.p_memsz - ProgramHeader.p_filesz);
-        auto DataRef = ArrayRef<uint8_t>(FullData.get(), ProgramHeader.p_memsz);
-        TheData = ConstantDataArray::get(Context, DataRef);
+        DataType = StructType::get(Context,
+                                   {
+                                     ArrayType::get(Uint8Ty, FileSize),
+                                     ArrayType::get(Uint8Ty, ZeroSize)
+                                   },
+                                   true);
       }
 
       // Create a new global variable
@@ -290,7 +338,7 @@ void CodeGenerator::parseELF(object::ObjectFile *TheBinary,
                                             DataType,
                                             !Segment.IsWriteable,
                                             GlobalValue::ExternalLinkage,
-                                            TheData,
+                                            nullptr,
                                             Name);
 
       // Force alignment to 1 and assign the variable to a specific section
@@ -318,6 +366,31 @@ void CodeGenerator::parseELF(object::ObjectFile *TheBinary,
     }
 }
 
+void CodeGenerator::materializeSegments() {
+  for (SegmentInfo &Segment : Segments) {
+    if (Segment.Variable->hasInitializer())
+      continue;
+
+    Type *DataType = Segment.Variable->getType()->getElementType();
+    Constant *TheData = nullptr;
+    if (auto *Struct = dyn_cast<StructType>(DataType)) {
+      Constant *FileData = ConstantDataArray::get(Context, Segment.Data);
+      Type *ZeroType = Struct->getElementType(1);
+      TheData = ConstantStruct::get(Struct,
+                                    {
+                                      FileData,
+                                      ConstantAggregateZero::get(ZeroType)
+                                    });
+    } else if (Segment.Data.size() == 0) {
+      TheData = ConstantAggregateZero::get(DataType);
+    } else {
+      TheData = ConstantDataArray::get(Context, Segment.Data);
+    }
+
+    Segment.Variable->setInitializer(TheData);
+  }
+}
+
 static BasicBlock *replaceFunction(Function *ToReplace) {
   ToReplace->setLinkage(GlobalValue::InternalLinkage);
   ToReplace->dropAllReferences();
@@ -520,6 +593,7 @@ static ReturnInst *createRet(Instruction *Position) {
 /// Then when we reach the root function, set cpu_loop_exiting to false after
 /// the call.
 bool CpuLoopExitPass::runOnModule(llvm::Module& M) {
+  ScopedPhase Phase("CpuLoopExitPass");
   Function *CpuLoopExit = M.getFunction("cpu_loop_exit");
 
   purgeNoReturn(CpuLoopExit);
@@ -696,18 +770,190 @@ void CodeGenerator::translate(uint64_t VirtualAddress,
                             *HelpersModule,
                             TargetArchitecture);
 
+  // If a previous run on the same input left its results in the cache, all
+  // the jump targets are known in advance: skip the scan of the global data
+  // and run OSRA only to handle the indirect jumps.
+  Cache->addToKey(VirtualAddress);
+
+  // The cache doesn't hold the data read by the analyses, which is part of
+  // the state of the translation, therefore ignore it when saving the state
+  bool CacheHit = SaveStatePath.size() == 0 && Cache->load();
+
+  // Hash the pages of the input, to compare them with the ones of a previous
+  // translation and to save the state of this one
+  TranslationState State;
+  if (PreviousStatePath.size() != 0 || SaveStatePath.size() != 0)
+    for (SegmentInfo &Segment : Segments)
+      State.addSegment(Segment.StartVirtualAddress,
+                       Segment.EndVirtualAddress,
+                       Segment.Data,
+                       Segment.IsExecutable);
+
+  // Compare the input with the one of a previous translation: looking for new
+  // jump targets with OSRA is required only if the code or the data read by
+  // the analyses changed
+  TranslationState Previous;
+  TranslationState::RangesVector ChangedPages;
+  bool Incremental = PreviousStatePath.size() != 0 && !CacheHit;
+  bool ReadDataChanged = false;
+  bool AnalysesChanged = true;
+  if (Incremental) {
+    if (!Previous.read(PreviousStatePath)) {
+      dbgs() << "Couldn't load the state of the previous translation "
+             << PreviousStatePath << "\n";
+      abort();
+    }
+
+    ChangedPages = State.changedPages(Previous);
+
+    bool CodeChanged = false;
+    for (SegmentInfo &Segment : Segments)
+      CodeChanged |= Segment.IsExecutable
+        && TranslationState::overlaps(ChangedPages,
+                                      Segment.StartVirtualAddress,
+                                      Segment.EndVirtualAddress);
+
+    for (auto &Range : Previous.ReadRanges)
+      ReadDataChanged |= TranslationState::overlaps(ChangedPages,
+                                                    Range.first,
+                                                    Range.second);
+
+    AnalysesChanged = CodeChanged || ReadDataChanged;
+
+    uint64_t ChangedSize = 0;
+    for (auto &Range : ChangedPages)
+      ChangedSize += Range.second - Range.first;
+    setCounter("changed-pages", ChangedSize / TranslationState::PageSize);
+  }
+
   auto *PCReg = Variables.getByEnvOffset(ptc.pc, "pc").first;
   JumpTargetManager JumpTargets(MainFunction,
                                 PCReg,
                                 SourceArchitecture,
                                 Segments,
-                                EnableOSRA);
+                                EnableOSRA,
+                                IncrementalHarvest);
+
+  if (CacheHit || !AnalysesChanged)
+    JumpTargets.setJumpTargetsKnown();
+
+  if (CacheHit) {
+    using JTReason = JumpTargetManager::JTReason;
+    for (auto &P : Cache->jumpTargets())
+      JumpTargets.registerJT(P.first, static_cast<JTReason>(P.second));
+    setCounter("cached-jump-targets", Cache->jumpTargets().size());
+  }
+
+  // Register the jump targets of the previous translation still valid. A jump
+  // target is invalid if the input basic block containing it overlaps a
+  // changed page. Which data led SET to a jump target is not recorded,
+  // therefore, if any data read by the analyses changed, all the jump targets
+  // found only through SET are invalid too.
+  if (Incremental) {
+    using JTReason = JumpTargetManager::JTReason;
+    const uint32_t SETReasons = (JumpTargetManager::SETToPC
+                                 | JumpTargetManager::SETNotToPC
+                                 | JumpTargetManager::SumJump);
+    const TranslationState::RangesVector &BBs = Previous.OriginalBBs;
+    unsigned Reused = 0;
+    unsigned Invalidated = 0;
+    for (auto &P : Previous.JumpTargets) {
+      uint64_t PC = P.first;
+      uint32_t Reasons = P.second & ~JumpTargetManager::Hint;
+
+      uint64_t Start = PC;
+      uint64_t End = PC + 1;
+      std::pair<uint64_t, uint64_t> Key(PC, UINT64_MAX);
+      auto It = std::upper_bound(BBs.begin(), BBs.end(), Key);
+      if (It != BBs.begin() && (--It)->second > PC) {
+        Start = It->first;
+        End = It->second;
+      }
+
+      if (TranslationState::overlaps(ChangedPages, Start, End)
+          || (ReadDataChanged && (Reasons & ~SETReasons) == 0)
+          || !JumpTargets.isPC(PC)) {
+        Invalidated++;
+        continue;
+      }
+
+      Reasons = P.second | JumpTargetManager::Hint;
+      JumpTargets.registerJT(PC, static_cast<JTReason>(Reasons));
+      Reused++;
+    }
+
+    // The jump targets reused depend on the data read by the previous
+    // analyses, keep track of it
+    for (auto &Range : Previous.ReadRanges)
+      JumpTargets.registerReadRange(Range.first, Range.second - Range.first);
+
+    DBG("cache", dbg << "Reusing " << std::dec << Reused << " jump targets, "
+                     << Invalidated << " have been invalidated by "
+                     << ChangedPages.size() << " changed ranges"
+                     << (AnalysesChanged ? "" : ", no new ones are expected")
+                     << "\n");
+
+    setCounter("reused-jump-targets", Reused);
+    setCounter("invalidated-jump-targets", Invalidated);
+  }
+
+  // Register the jump targets provided by the user, preserving the reasons
+  // they have been found for, which are relevant for the detection of the
+  // functions
+  if (JumpTargetsHintsPath.size() != 0) {
+    JumpTargetsList Hints;
+    if (!readJumpTargets(JumpTargetsHintsPath, Hints)) {
+      dbgs() << "Couldn't load the jump targets " << JumpTargetsHintsPath
+             << "\n";
+      abort();
+    }
+
+    using JTReason = JumpTargetManager::JTReason;
+    unsigned NewJumpTargets = 0;
+    for (auto &P : Hints) {
+      if (!JumpTargets.isPC(P.first))
+        continue;
+
+      if (!JumpTargets.isJumpTarget(P.first))
+        NewJumpTargets++;
+      uint32_t Reasons = P.second | JumpTargetManager::Hint;
+      JumpTargets.registerJT(P.first, static_cast<JTReason>(Reasons));
+    }
+
+    setCounter("hint-jump-targets", NewJumpTargets);
+  }
 
   if (VirtualAddress == 0) {
-    JumpTargets.harvestGlobalData();
+    // The global data in the unchanged pages has already been scanned by the
+    // previous translation
+    if (Incremental)
+      JumpTargets.harvestGlobalData(&ChangedPages);
+    else if (!CacheHit)
+      JumpTargets.harvestGlobalData();
     VirtualAddress = EntryPoint;
   }
 
+  // Register the jump targets reached at run-time according to the profile
+  ExecutionProfile Profile;
+  if (ProfilePath.size() != 0) {
+    if (!Profile.read(ProfilePath)) {
+      dbgs() << "Couldn't load the profile " << ProfilePath << "\n";
+      abort();
+    }
+
+    unsigned NewJumpTargets = 0;
+    for (auto &P : Profile.hits()) {
+      if (!JumpTargets.isPC(P.first))
+        continue;
+
+      if (!JumpTargets.isJumpTarget(P.first))
+        NewJumpTargets++;
+      JumpTargets.registerJT(P.first, JumpTargetManager::Profile);
+    }
+
+    setCounter("profile-jump-targets", NewJumpTargets);
+  }
+
   dbg << "Entry address: 0x" << std::hex << VirtualAddress << std::endl;
 
   BasicBlock *Head = JumpTargets.getBlockAt(VirtualAddress);
@@ -730,6 +976,9 @@ void CodeGenerator::translate(uint64_t VirtualAddress,
                                    TargetArchitecture);
 
   while (Entry != nullptr) {
+    ResourceUsage LiftingStart = {};
+    if (TimeReportEnabled)
+      LiftingStart = ResourceUsage::now();
     Builder.SetInsertPoint(Entry);
 
     Translator.reset();
@@ -850,12 +1099,16 @@ void CodeGenerator::translate(uint64_t VirtualAddress,
       }
 
       // Create a new metadata referencing the PTC instruction we have just
-      // translated
-      std::stringstream PTCStringStream;
-      dumpInstruction(PTCStringStream, InstructionList.get(), j);
-      std::string PTCString = PTCStringStream.str() + "\n";
-      MDString *MDPTCString = MDString::get(Context, PTCString);
-      MDNode* MDPTCInstr = MDNode::getDistinct(Context, MDPTCString);
+      // translated. The PTC instruction list is not preserved, so this cannot
+      // be done lazily: do it only if some debug information is required.
+      MDNode* MDPTCInstr = nullptr;
+      if (Debug->hasDebugInfo()) {
+        std::stringstream PTCStringStream;
+        dumpInstruction(PTCStringStream, InstructionList.get(), j);
+        std::string PTCString = PTCStringStream.str() + "\n";
+        MDString *MDPTCString = MDString::get(Context, PTCString);
+        MDPTCInstr = MDNode::getDistinct(Context, MDPTCString);
+      }
 
       // Set metadata for all the new instructions
       for (BasicBlock *Block : Blocks) {
@@ -881,6 +1134,9 @@ void CodeGenerator::translate(uint64_t VirtualAddress,
       Builder.CreateUnreachable();
     }
 
+    if (TimeReportEnabled)
+      recordPhase("lifting", LiftingStart);
+
     // Obtain a new program counter to translate
     std::tie(VirtualAddress, Entry) = JumpTargets.peek();
   } // End translations loop
@@ -949,6 +1205,10 @@ void CodeGenerator::translate(uint64_t VirtualAddress,
   replaceFunctionWithRet(HelpersModule->getFunction("page_get_flags"),
                          0xffffffff);
 
+  ResourceUsage LinkingStart = {};
+  if (TimeReportEnabled)
+    LinkingStart = ResourceUsage::now();
+
   // HACK: the LLVM linker does not import non-static functions anymore if
   //       LinkOnlyNeeded is specified. We don't want this so mark all the
   //       non-static symbols not directly imported as static.
@@ -981,6 +1241,9 @@ void CodeGenerator::translate(uint64_t VirtualAddress,
   assert(!Result && "Linking failed");
   (void) Result;
 
+  if (TimeReportEnabled)
+    recordPhase("linkHelpers", LinkingStart);
+
   Variables.setDataLayout(&TheModule->getDataLayout());
 
   legacy::PassManager PM;
@@ -993,25 +1256,131 @@ void CodeGenerator::translate(uint64_t VirtualAddress,
   // TODO: transform the following in passes?
   JumpTargets.collectBBSummary(BBSummaryPath);
 
-  JumpTargets.translateIndirectJumps();
+  setCounter("local-dispatch-jumps", JumpTargets.translateIndirectJumps());
 
   JumpTargets.finalizeJumpTargets();
 
   purgeDeadBlocks(MainFunction);
 
   legacy::FunctionPassManager FPM(&*TheModule);
-  FPM.add(new FunctionBoundariesDetectionPass(&JumpTargets, ""));
+  auto *FBDP = new FunctionBoundariesDetectionPass(&JumpTargets, "");
+  FPM.add(FBDP);
   FPM.run(*MainFunction);
 
+  setCounter("jump-targets", std::distance(JumpTargets.begin(),
+                                           JumpTargets.end()));
+
+  if ((Cache->isEnabled() && !CacheHit)
+      || ExportJumpTargetsPath.size() != 0
+      || SaveStatePath.size() != 0) {
+    JumpTargetsList Results;
+    for (auto &P : JumpTargets)
+      Results.push_back({ P.first, P.second.getReasons() });
+
+    if (Cache->isEnabled() && !CacheHit)
+      Cache->store(Results);
+
+    if (ExportJumpTargetsPath.size() != 0
+        && !writeJumpTargets(ExportJumpTargetsPath, Results)) {
+      dbgs() << "Couldn't write the jump targets to " << ExportJumpTargetsPath
+             << "\n";
+      abort();
+    }
+
+    if (SaveStatePath.size() != 0) {
+      State.OriginalBBs = JumpTargets.originalBBs();
+      for (auto &Interval : JumpTargets.readRange())
+        State.ReadRanges.push_back({ Interval.lower(), Interval.upper() });
+      State.JumpTargets = std::move(Results);
+
+      if (!State.write(SaveStatePath)) {
+        dbgs() << "Couldn't save the state of the translation to "
+               << SaveStatePath << "\n";
+        abort();
+      }
+    }
+  }
+
+  if (!Profile.empty())
+    JumpTargets.applyProfile(Profile);
+
+  // Collect the inline caches now, isolating functions invalidates the
+  // results of the FunctionBoundariesDetectionPass
+  InlineCacheBuilder InlineCacheSites(MainFunction,
+                                      &JumpTargets,
+                                      InlineCaches,
+                                      InlineCacheCounters);
+  if (InlineCaches > 0)
+    InlineCacheSites.collect(FBDP->functions(),
+                             FBDP->functionCalls(),
+                             FBDP->returns());
+
+  ShadowStackBuilder ShadowStackSites(MainFunction, &JumpTargets, ShadowStack);
+  if (ShadowStack > 0)
+    ShadowStackSites.collect(FBDP->functionCalls(), FBDP->returns());
+
+  if (IsolateFunctions) {
+    FunctionIsolator Isolator(MainFunction,
+                              &JumpTargets,
+                              FBDP->functions(),
+                              FBDP->functionCalls());
+    setCounter("isolated-functions", Isolator.run());
+  }
+
+  if (InlineCaches > 0)
+    setCounter("inline-caches", InlineCacheSites.run());
+
+  if (ShadowStack > 0)
+    setCounter("shadow-stack-returns", ShadowStackSites.run());
+
+  if (Dispatcher == DispatcherType::Table)
+    setCounter("dispatcher-table-targets",
+               JumpTargets.createDispatcherTables());
+
   Translator.finalizeNewPCMarkers(CoveragePath, EnableTracing);
+  materializeSegments();
   Debug->generateDebugInfo();
 
 }
 
+/// \brief Write \p TheModule to \p Path, as LLVM bitcode or textual LLVM IR
+static void writeModule(Module *TheModule, std::string Path, bool Bitcode) {
+  std::error_code EC;
+  raw_fd_ostream Output(Path, EC, sys::fs::F_None);
+  if (EC) {
+    dbgs() << "Couldn't open " << Path << ": " << EC.message() << "\n";
+    abort();
+  }
+
+  if (Bitcode)
+    WriteBitcodeToFile(TheModule, Output);
+  else
+    TheModule->print(Output, nullptr);
+}
+
 void CodeGenerator::serialize() {
+  ScopedPhase Phase("serialize");
+
+  // Move part of the functions to other modules, which are written next to the
+  // output file
+  if (SplitModules > 1) {
+    ModulePartitioner Partitioner(TheModule.get(), SplitModules);
+    std::vector<std::unique_ptr<Module>> Parts = Partitioner.run();
+    for (unsigned I = 0; I < Parts.size(); I++)
+      writeModule(Parts[I].get(),
+                  OutputPath + ".part" + std::to_string(I + 1),
+                  EmitBitcode);
+  }
+
+  if (EmitBitcode) {
+    writeModule(TheModule.get(), OutputPath, true);
+    return;
+  }
+
   // Ask the debug handler if it already has a good copy of the IR, if not dump
-  // it
-  if (!Debug->copySource()) {
+  // it. The copy contains the whole module, so it can't be used if the module
+  // has been split.
+  if (SplitModules > 1 || !Debug->copySource()) {
     std::ofstream Output(OutputPath);
     Debug->print(Output, false);
   }
@@ -33,11 +33,88 @@ class ObjectFile;
 
 };
 
+class AnalysisCache;
 class DebugHelper;
 
 /// Translator from binary code to LLVM IR.
 class CodeGenerator {
 public:
+  /// Options controlling the translation and the shape of the output.
+  struct Options {
+    /// Type of debug information to generate.
+    DebugInfoType DebugInfo = DebugInfoType::None;
+    /// Path where the debugging source file must be written. If an empty
+    /// string, the output file name plus ".S", if \p DebugInfo is
+    /// DebugInfoType::OriginalAssembly, or ".ptc", if \p DebugInfo is
+    /// DebugInfoType::PTC.
+    std::string DebugPath;
+    /// Path where the information about how the linking should be stored. If
+    /// an empty string, the output file name with a ".li.csv" suffix will be
+    /// used.
+    std::string LinkingInfoPath;
+    /// Path where the information about instruction coverage should be
+    /// stored. If an empty string, the output file name with a
+    /// ".coverage.csv" suffix will be used.
+    std::string CoveragePath;
+    /// Path where the basic block summary should be stored. If an empty
+    /// string, the output file name with a ".bbsummary.csv" suffix will be
+    /// used.
+    std::string BBSummaryPath;
+    /// Whether OSRA should be used to discover additional jump targets or
+    /// not.
+    bool EnableOSRA = true;
+    /// Whether the harvesting phase should only clean up the basic blocks
+    /// created since the previous round, instead of running the cleanup
+    /// passes on the whole function.
+    bool IncrementalHarvest = false;
+    /// Whether tracing in the ouptut binary should be enabled, that is,
+    /// whether calls to an external `newPC` function should be removed at the
+    /// end of the translation or not.
+    bool EnableTracing = false;
+    /// Whether the sections, instead of the segments, should be used to
+    /// identify the executable code.
+    bool UseSections = false;
+    /// Whether the output should be written as LLVM bitcode instead of
+    /// textual LLVM IR.
+    bool EmitBitcode = false;
+    /// Whether each detected function should be moved out of the root
+    /// function into an LLVM function of its own.
+    bool IsolateFunctions = false;
+    /// Number of modules the output should be split into. The first one is
+    /// written to the output path, the others to the output path with a
+    /// ".partN" suffix.
+    unsigned SplitModules = 1;
+    /// Type of dispatcher to emit in the output.
+    DispatcherType Dispatcher = DispatcherType::Switch;
+    /// Maximum number of destinations of the inline caches emitted in front
+    /// of the function returns, 0 to disable them.
+    unsigned InlineCaches = 0;
+    /// Whether the inline caches should count their hits and misses.
+    bool InlineCacheCounters = false;
+    /// Path of the execution profile to use to guide the translation. If an
+    /// empty string, no profile will be used.
+    std::string ProfilePath;
+    /// Number of entries of the shadow stack used to jump directly to the
+    /// return addresses, 0 to disable it.
+    unsigned ShadowStack = 0;
+    /// Directory where the results of the analyses are cached across runs.
+    /// If an empty string, no cache will be used.
+    std::string CacheDirectory;
+    /// Path of a list of jump targets to register before starting the
+    /// translation. If an empty string, no hint will be used.
+    std::string JumpTargetsHintsPath;
+    /// Path where the list of the jump targets found should be saved. If an
+    /// empty string, it won't be saved.
+    std::string ExportJumpTargetsPath;
+    /// Path of the state saved by the translation of a previous version of
+    /// the input, whose results still valid should be reused. If an empty
+    /// string, the translation starts from scratch.
+    std::string PreviousStatePath;
+    /// Path where the state of the translation should be saved. If an empty
+    /// string, it won't be saved.
+    std::string SaveStatePath;
+  };
+
   /// Create a new code generator translating code from an architecture to
   /// another, writing the corresponding LLVM IR and other useful information to
   /// the specified paths.
@@ -46,34 +123,12 @@ public:
   /// \param Target target architecture.
   /// \param Output path where the generate LLVM IR must be saved.
   /// \param Helpers path of the LLVM IR file containing the QEMU helpers.
-  /// \param DebugInfo type of debug information to generate.
-  /// \param Debug path where the debugging source file must be written. If an
-  ///        empty string, the output file name plus ".S", if \p DebugInfo is
-  ///        DebugInfoType::OriginalAssembly, or ".ptc", if \p DebugInfo is
-  ///        DebugInfoType::PTC.
-  /// \param LinkingInfo path where the information about how the linking should
-  ///        be stored. If an empty string, the output file name with a
-  ///        ".li.csv" suffix will be used.
-  /// \param Coverage path where the information about instruction coverage
-  ///        should be stored. If an empty string, the output file name with a
-  ///        ".coverage.csv" suffix will be used.
-  /// \param EnableOSRA specify whether OSRA should be used to discover
-  ///        additional jump targets or not.
-  /// \param EnableTracing specify whether tracing in the ouptut binary should
-  ///        be enabled, that is, whether calls to an external `newPC` function
-  ///        should be removed at the end of the translation or not.
+  /// \param Opts options controlling the translation.
   CodeGenerator(std::string Input,
                 Architecture& Target,
                 std::string Output,
                 std::string Helpers,
-                DebugInfoType DebugInfo,
-                std::string Debug,
-                std::string LinkingInfo,
-                std::string Coverage,
-                std::string BBSummary,
-                bool EnableOSRA,
-                bool EnableTracing,
-                bool UseSections);
+                const Options &Opts);
 
   ~CodeGenerator();
 
@@ -103,6 +158,13 @@ private:
                 std::string LinkingInfo,
                 bool UseSections);
 
+  /// \brief Set the initializers of the segments' global variables
+  ///
+  /// Until this function is called, segments data is only available in the
+  /// mapping of the input file, so that it's not copied in the LLVMContext
+  /// while the analyses run.
+  void materializeSegments();
+
 private:
   Architecture SourceArchitecture;
   Architecture TargetArchitecture;
@@ -111,6 +173,7 @@ private:
   std::unique_ptr<llvm::Module> HelpersModule;
   std::string OutputPath;
   std::unique_ptr<DebugHelper> Debug;
+  std::unique_ptr<AnalysisCache> Cache;
   llvm::object::OwningBinary<llvm::object::Binary> BinaryHandle;
   std::vector<SegmentInfo> Segments;
   uint64_t EntryPoint;
@@ -121,7 +184,20 @@ private:
 
   std::string CoveragePath;
   bool EnableOSRA;
+  bool IncrementalHarvest;
   bool EnableTracing;
+  bool EmitBitcode;
+  bool IsolateFunctions;
+  unsigned SplitModules;
+  DispatcherType Dispatcher;
+  unsigned InlineCaches;
+  bool InlineCacheCounters;
+  std::string ProfilePath;
+  unsigned ShadowStack;
+  std::string JumpTargetsHintsPath;
+  std::string ExportJumpTargetsPath;
+  std::string PreviousStatePath;
+  std::string SaveStatePath;
   std::string BBSummaryPath;
   std::string FunctionListPath;
 };
@@ -6,9 +6,13 @@
 //
 
 // Standard includes
+#include <cassert>
 #include <queue>
 #include <set>
 #include <stack>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 /// \brief Queue where an element cannot be re-inserted if it's already in the
 ///        queue
@@ -89,6 +93,87 @@ private:
   std::vector<T> Queue;
 };
 
+/// \brief Stack of key-value pairs allowing to remove an arbitrary element,
+///        given its key, in constant time
+///
+/// Removed elements are left in place as tombstones, and skipped when popping.
+template<typename K, typename V>
+class IndexedStack {
+public:
+  using value_type = std::pair<K, V>;
+
+public:
+  void push(K Key, V Value) {
+    assert(Index.count(Key) == 0);
+    Index[Key] = Stack.size();
+    Stack.push_back(value_type(Key, Value));
+  }
+
+  bool empty() const {
+    return Index.empty();
+  }
+
+  size_t size() const { return Index.size(); }
+
+  bool count(K Key) const { return Index.count(Key) != 0; }
+
+  value_type pop() {
+    assert(!empty());
+    dropTombstones();
+    value_type Result = Stack.back();
+    Stack.pop_back();
+    Index.erase(Result.first);
+    return Result;
+  }
+
+  /// \brief Remove the element associated to \p Key, if present
+  ///
+  /// \return true if the element was in the stack, in which case its value is
+  ///         stored in \p Value.
+  bool erase(K Key, V &Value) {
+    auto It = Index.find(Key);
+    if (It == Index.end())
+      return false;
+
+    Value = Stack[It->second].second;
+    Index.erase(It);
+
+    // Compact the stack if it's mostly made of tombstones
+    dropTombstones();
+    if (Stack.size() > 2 * Index.size() + 64)
+      compact();
+
+    return true;
+  }
+
+private:
+  bool isLive(size_t Position) const {
+    auto It = Index.find(Stack[Position].first);
+    return It != Index.end() && It->second == Position;
+  }
+
+  void dropTombstones() {
+    while (!Stack.empty() && !isLive(Stack.size() - 1))
+      Stack.pop_back();
+  }
+
+  void compact() {
+    std::vector<value_type> Compacted;
+    Compacted.reserve(Index.size());
+    for (size_t I = 0; I < Stack.size(); I++) {
+      if (isLive(I)) {
+        Index[Stack[I].first] = Compacted.size();
+        Compacted.push_back(Stack[I]);
+      }
+    }
+    Stack.swap(Compacted);
+  }
+
+private:
+  std::vector<value_type> Stack;
+  std::unordered_map<K, size_t> Index;
+};
+
 template<class T>
 static inline void freeContainer(T &Container) {
   T Empty;
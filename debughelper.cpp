@@ -7,6 +7,7 @@
 
 // Standard includes
 #include <fstream>
+#include <sstream>
 
 // LLVM includes
 #include "llvm/IR/AssemblyAnnotationWriter.h"
@@ -18,6 +19,8 @@
 
 // Local includes
 #include "debughelper.h"
+#include "ptcdump.h"
+#include "timereport.h"
 
 using namespace llvm;
 
@@ -178,7 +181,33 @@ void DebugHelper::newFunction(Function *Function) {
   }
 }
 
+void DebugHelper::disassembleOriginalInstructions() {
+  LLVMContext &Context = TheModule->getContext();
+  for (Function &F : *TheModule) {
+    for (BasicBlock &BB : F) {
+      for (Instruction &I : BB) {
+        MDNode *Node = I.getMetadata(OriginalInstrMDKind);
+        if (Node == nullptr || Node->getOperand(0).get() != nullptr)
+          continue;
+
+        auto *MDPC = cast<ConstantAsMetadata>(Node->getOperand(1));
+        uint64_t PC = cast<ConstantInt>(MDPC->getValue())->getLimitedValue();
+
+        std::stringstream OriginalStringStream;
+        disassembleOriginal(OriginalStringStream, PC);
+        Node->replaceOperandWith(0, MDString::get(Context,
+                                                  OriginalStringStream.str()));
+      }
+    }
+  }
+}
+
 void DebugHelper::generateDebugInfo() {
+  ScopedPhase Phase("generateDebugInfo");
+
+  if (Type != DebugInfoType::None)
+    disassembleOriginalInstructions();
+
   switch (Type) {
   case DebugInfoType::PTC:
   case DebugInfoType::OriginalAssembly:
@@ -94,6 +94,9 @@ public:
   /// Copy the debug file to the output path, if they are the same
   bool copySource();
 
+  /// \brief Return true if some kind of debug information has been requested
+  bool hasDebugInfo() const { return Type != DebugInfoType::None; }
+
 private:
   /// Create a new AssemblyAnnotationWriter
   ///
@@ -101,6 +104,12 @@ private:
   ///        information referred to itself or not.
   DebugAnnotationWriter *annotator(bool DebugInfo);
 
+  /// \brief Produce the disassembly of the original instructions
+  ///
+  /// During the translation the original instruction metadata only record the
+  /// PC, this function fills in the corresponding disassembly.
+  void disassembleOriginalInstructions();
+
 private:
   std::string OutputPath;
   std::string DebugPath;
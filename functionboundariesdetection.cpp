@@ -32,6 +32,7 @@
 #include "functionboundariesdetection.h"
 #include "ir-helpers.h"
 #include "jumptargetmanager.h"
+#include "timereport.h"
 
 using namespace llvm;
 
@@ -58,6 +59,14 @@ public:
 
   map<BasicBlock *, vector<BasicBlock *>> run();
 
+  std::map<TerminatorInst *, BasicBlock *> functionCalls() {
+    return std::move(FunctionCalls);
+  }
+
+  std::set<TerminatorInst *> returns() {
+    return std::move(Returns);
+  }
+
 private:
   enum RelationType {
     UnknownRelation = 0,
@@ -647,8 +656,11 @@ std::string FBD::CFEPRelation::describe() const {
 }
 
 bool FBDP::runOnFunction(Function &F) {
+  ScopedPhase Phase("FunctionBoundariesDetection");
   FBD Impl(F, JTM);
   Functions = Impl.run();
+  FunctionCalls = Impl.functionCalls();
+  Returns = Impl.returns();
   serialize();
   return false;
 }
@@ -7,13 +7,16 @@
 
 // Standard includes
 #include <map>
+#include <set>
 #include <string>
+#include <vector>
 
 // LLVM includes
 #include "llvm/Pass.h"
 
 namespace llvm {
 class BasicBlock;
+class TerminatorInst;
 }
 
 class JumpTargetManager;
@@ -34,6 +37,24 @@ public:
 
   bool runOnFunction(llvm::Function &F) override;
 
+  /// \brief Return the detected functions
+  ///
+  /// \return a map associating to each function entry point the list of
+  ///         basic blocks belonging to the function.
+  const std::map<llvm::BasicBlock *, std::vector<llvm::BasicBlock *>> &
+  functions() const { return Functions; }
+
+  /// \brief Return the detected function calls
+  ///
+  /// \return a map associating to each terminator performing a function call
+  ///         the basic block where the callee is expected to return.
+  const std::map<llvm::TerminatorInst *, llvm::BasicBlock *> &
+  functionCalls() const { return FunctionCalls; }
+
+  /// \brief Return the terminators detected as return instructions
+  const std::set<llvm::TerminatorInst *> &
+  returns() const { return Returns; }
+
 private:
   void serialize() const;
 
@@ -41,6 +62,8 @@ private:
   JumpTargetManager *JTM;
   std::string SerializePath;
   std::map<llvm::BasicBlock *, std::vector<llvm::BasicBlock *>> Functions;
+  std::map<llvm::TerminatorInst *, llvm::BasicBlock *> FunctionCalls;
+  std::set<llvm::TerminatorInst *> Returns;
 };
 
 #endif // _FUNCTIONBOUNDARIESDETECTION_H
@@ -0,0 +1,187 @@
+/// \file inlinecaches.cpp
+/// \brief Emit inline caches in front of the jumps to the dispatcher.
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <set>
+
+// LLVM includes
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+// Local includes
+#include "debug.h"
+#include "inlinecaches.h"
+#include "ir-helpers.h"
+#include "jumptargetmanager.h"
+#include "timereport.h"
+
+using namespace llvm;
+
+void InlineCacheBuilder::collect(const FunctionsMap &Functions,
+                                 const FunctionCallsMap &FunctionCalls,
+                                 const ReturnsSet &Returns) {
+  BasicBlock *Dispatcher = JTM->dispatcher();
+
+  // Collect the return addresses of the calls to each function
+  std::map<BasicBlock *, std::set<uint64_t>> CallersReturnPCs;
+  for (auto &P : FunctionCalls) {
+    uint64_t ReturnPC = getBasicBlockPC(P.second);
+    for (BasicBlock *Callee : P.first->successors())
+      if (Callee != Dispatcher)
+        CallersReturnPCs[Callee].insert(ReturnPC);
+  }
+
+  // A basic block can be part of multiple functions, merge the predictions
+  std::map<TerminatorInst *, std::set<uint64_t>> Predictions;
+  for (auto &P : Functions) {
+    auto It = CallersReturnPCs.find(P.first);
+    if (It == CallersReturnPCs.end())
+      continue;
+
+    for (BasicBlock *BB : P.second) {
+      TerminatorInst *T = BB->getTerminator();
+      if (Returns.count(T) != 0)
+        Predictions[T].insert(It->second.begin(), It->second.end());
+    }
+  }
+
+  for (auto &P : Predictions) {
+    if (P.second.size() > MaxEntries) {
+      DBG("ic", dbg << "Too many destinations for " << getName(P.first)
+                    << "\n");
+      continue;
+    }
+
+    Site NewSite;
+    NewSite.Jump = P.first;
+    NewSite.PC = JTM->getPC(P.first).first;
+    NewSite.Destinations.assign(P.second.begin(), P.second.end());
+    Sites.push_back(NewSite);
+  }
+}
+
+unsigned InlineCacheBuilder::run() {
+  ScopedPhase Phase("InlineCaches");
+
+  Module *TheModule = Root->getParent();
+  LLVMContext &Context = TheModule->getContext();
+  BasicBlock *Dispatcher = JTM->dispatcher();
+  Value *PCReg = JTM->pcReg();
+  auto *PCType = cast<IntegerType>(PCReg->getType()->getPointerElementType());
+
+  // Find the basic block currently handling each jump target in the root
+  // function: the isolation of functions might have replaced the original one
+  std::map<uint64_t, BasicBlock *> Targets;
+  auto *DispatcherSwitch = cast<SwitchInst>(Dispatcher->getTerminator());
+  for (auto &Case : DispatcherSwitch->cases())
+    Targets[Case.getCaseValue()->getZExtValue()] = Case.getCaseSuccessor();
+
+  GlobalVariable *Counters = nullptr;
+  Type *CounterType = Type::getInt64Ty(Context);
+  if (EmitCounters)
+    Counters = new GlobalVariable(*TheModule,
+                                  CounterType->getPointerTo(),
+                                  false,
+                                  GlobalValue::ExternalLinkage,
+                                  nullptr,
+                                  "inline_cache_counters");
+
+  IRBuilder<> Builder(Context);
+  auto Increment = [&] (unsigned Index) {
+    Value *Base = Builder.CreateLoad(Counters);
+    Value *Address = Builder.CreateGEP(Base, Builder.getInt32(Index));
+    Builder.CreateStore(Builder.CreateAdd(Builder.CreateLoad(Address),
+                                          ConstantInt::get(CounterType, 1)),
+                        Address);
+  };
+
+  std::vector<Constant *> SitePCs;
+  for (Site &S : Sites) {
+    auto *Jump = cast_or_null<TerminatorInst>(S.Jump);
+    if (Jump == nullptr || Jump->getParent()->getParent() != Root)
+      continue;
+
+    unsigned Index = SitePCs.size();
+    BasicBlock *Cache = BasicBlock::Create(Context, "ic", Root);
+    BasicBlock *Miss = Dispatcher;
+    if (EmitCounters) {
+      Miss = BasicBlock::Create(Context, "ic.miss", Root);
+      Builder.SetInsertPoint(Miss);
+      Increment(Index * 3 + 2);
+      Builder.CreateBr(Dispatcher);
+    }
+
+    Builder.SetInsertPoint(Cache);
+    Value *PC = Builder.CreateLoad(PCReg);
+    SwitchInst *Switch = Builder.CreateSwitch(PC,
+                                              Miss,
+                                              S.Destinations.size());
+
+    for (uint64_t Destination : S.Destinations) {
+      auto It = Targets.find(Destination);
+      if (It == Targets.end())
+        continue;
+      BasicBlock *Target = It->second;
+
+      BasicBlock *Hit = Cache;
+      if (EmitCounters) {
+        Hit = BasicBlock::Create(Context, "ic.hit", Root);
+        Builder.SetInsertPoint(Hit);
+        Increment(Index * 3 + 1);
+        Builder.CreateBr(Target);
+        Switch->addCase(ConstantInt::get(PCType, Destination), Hit);
+      } else {
+        Switch->addCase(ConstantInt::get(PCType, Destination), Target);
+      }
+
+      // The new predecessor provides the same values as the dispatcher
+      for (Instruction &I : *Target) {
+        auto *Phi = dyn_cast<PHINode>(&I);
+        if (Phi == nullptr)
+          break;
+
+        Value *Incoming = UndefValue::get(Phi->getType());
+        int DispatcherIndex = Phi->getBasicBlockIndex(Dispatcher);
+        if (DispatcherIndex >= 0)
+          Incoming = Phi->getIncomingValue(DispatcherIndex);
+        Phi->addIncoming(Incoming, Hit);
+      }
+    }
+
+    for (unsigned I = 0; I < Jump->getNumSuccessors(); I++)
+      if (Jump->getSuccessor(I) == Dispatcher)
+        Jump->setSuccessor(I, Cache);
+
+    SitePCs.push_back(ConstantInt::get(CounterType, S.PC));
+  }
+
+  // Let the support runtime know the inline caches and their PCs
+  if (EmitCounters) {
+    auto *SitesType = ArrayType::get(CounterType, SitePCs.size());
+    new GlobalVariable(*TheModule,
+                       SitesType,
+                       true,
+                       GlobalValue::ExternalLinkage,
+                       ConstantArray::get(SitesType, SitePCs),
+                       "inline_cache_sites");
+    new GlobalVariable(*TheModule,
+                       Type::getInt32Ty(Context),
+                       true,
+                       GlobalValue::ExternalLinkage,
+                       Builder.getInt32(SitePCs.size()),
+                       "inline_cache_sites_count");
+  }
+
+  DBG("ic", dbg << "Emitted " << std::dec << SitePCs.size()
+                << " inline caches out of " << Sites.size() << " sites\n");
+
+  return SitePCs.size();
+}
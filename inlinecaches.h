@@ -0,0 +1,90 @@
+#ifndef _INLINECACHES_H
+#define _INLINECACHES_H
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+
+// LLVM includes
+#include "llvm/IR/ValueHandle.h"
+
+namespace llvm {
+class BasicBlock;
+class Function;
+class TerminatorInst;
+}
+
+class JumpTargetManager;
+
+/// \brief Emit inline caches in front of the indirect jumps to the dispatcher
+///
+/// An inline cache compares the PC against the most likely destinations of an
+/// indirect jump and branches directly to them, going through the dispatcher
+/// only in case of a miss. Currently, the predicted destinations of the
+/// return instructions of a function are the return addresses of all the
+/// calls to it.
+///
+/// Optionally, each inline cache can count its hits and misses. In this case,
+/// the counters are stored in `inline_cache_counters`, provided by the
+/// support runtime: for each inline cache there are three 64-bit words, the
+/// PC of the jump, the number of hits and the number of misses.
+class InlineCacheBuilder {
+public:
+  using FunctionsMap = std::map<llvm::BasicBlock *,
+                                std::vector<llvm::BasicBlock *>>;
+  using FunctionCallsMap = std::map<llvm::TerminatorInst *, llvm::BasicBlock *>;
+  using ReturnsSet = std::set<llvm::TerminatorInst *>;
+
+  /// \param Root the function containing all the translated code.
+  /// \param JTM the JumpTargetManager associated to \p Root.
+  /// \param MaxEntries maximum number of destinations for an inline cache,
+  ///        jumps with more predicted destinations are left alone.
+  /// \param EmitCounters whether to count the hits and misses of each inline
+  ///        cache.
+  InlineCacheBuilder(llvm::Function *Root,
+                     JumpTargetManager *JTM,
+                     unsigned MaxEntries,
+                     bool EmitCounters) :
+    Root(Root),
+    JTM(JTM),
+    MaxEntries(MaxEntries),
+    EmitCounters(EmitCounters) { }
+
+  /// \brief Collect the jumps to handle and their predicted destinations
+  ///
+  /// This has to be done while the results of the
+  /// FunctionBoundariesDetectionPass are still valid, i.e., before the
+  /// functions are isolated.
+  void collect(const FunctionsMap &Functions,
+               const FunctionCallsMap &FunctionCalls,
+               const ReturnsSet &Returns);
+
+  /// \brief Emit an inline cache for each collected jump still in the root
+  ///        function
+  ///
+  /// \return the number of emitted inline caches.
+  unsigned run();
+
+private:
+  struct Site {
+    llvm::WeakVH Jump; ///< the terminator jumping to the dispatcher
+    uint64_t PC; ///< address of the jump instruction
+    std::vector<uint64_t> Destinations; ///< predicted destinations
+  };
+
+private:
+  llvm::Function *Root;
+  JumpTargetManager *JTM;
+  unsigned MaxEntries;
+  bool EmitCounters;
+
+  std::vector<Site> Sites;
+};
+
+#endif // _INLINECACHES_H
@@ -28,6 +28,7 @@
 #include "ptcinterface.h"
 #include "rai.h"
 #include "range.h"
+#include "timereport.h"
 #include "transformadapter.h"
 #include "variablemanager.h"
 
@@ -499,6 +500,7 @@ InstructionTranslator::InstructionTranslator(IRBuilder<>& Builder,
 
 void InstructionTranslator::finalizeNewPCMarkers(std::string &CoveragePath,
                                                  bool EnableTracing) {
+  ScopedPhase Phase("finalizeNewPCMarkers");
   std::vector<Instruction *> ToDelete;
   std::ofstream Output(CoveragePath);
 
@@ -554,14 +556,11 @@ InstructionTranslator::newInstruction(PTCInstruction *Instr,
   uint64_t PC = TheInstruction.pc();
   uint64_t NextPC = Next != nullptr ?  PTC::Instruction(Next).pc() : EndPC;
 
-  std::stringstream OriginalStringStream;
-  disassembleOriginal(OriginalStringStream, PC);
-  std::string OriginalString = OriginalStringStream.str();
+  // Only record the PC, the disassembly will be produced by DebugHelper, if
+  // required
   LLVMContext& Context = TheModule.getContext();
-  MDString *MDOriginalString = MDString::get(Context, OriginalString);
   auto *MDPC = ConstantAsMetadata::get(Builder.getInt64(PC));
-  MDNode *MDOriginalInstr = MDNode::getDistinct(Context,
-                                                { MDOriginalString, MDPC });
+  MDNode *MDOriginalInstr = MDNode::getDistinct(Context, { nullptr, MDPC });
 
   if (ForceNew)
     JumpTargets.registerJT(PC, JumpTargetManager::PostHelper);
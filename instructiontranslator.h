@@ -78,8 +78,9 @@ public:
   ///
   /// \return a tuple with 4 entries: the
   ///         InstructionTranslator::TranslationResult, an `MDNode` containing
-  ///         the disassembled instruction and the value of the PC and two
-  ///         `uint64_t` representing the current and next PC.
+  ///         the value of the PC (the disassembled instruction is filled in
+  ///         by DebugHelper, if required) and two `uint64_t` representing the
+  ///         current and next PC.
   // TODO: rename to newPC
   // TODO: the signature of this function is ugly
   std::tuple<TranslationResult,
@@ -0,0 +1,430 @@
+/// \file isolatefunctions.cpp
+/// \brief Move the detected functions out of the root function.
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <set>
+#include <sstream>
+
+// LLVM includes
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+// Local includes
+#include "datastructures.h"
+#include "debug.h"
+#include "ir-helpers.h"
+#include "isolatefunctions.h"
+#include "jumptargetmanager.h"
+#include "timereport.h"
+
+using namespace llvm;
+
+bool FunctionIsolator::isDispatcher(BasicBlock *BB) const {
+  return BB == JTM->dispatcher() || BB == JTM->dispatcherFail();
+}
+
+bool FunctionIsolator::isIsolable(BasicBlock *Entry,
+                                  const std::vector<BasicBlock *> &Members)
+  const {
+  if (getBasicBlockPC(Entry) == 0)
+    return false;
+
+  std::set<BasicBlock *> MemberSet(Members.begin(), Members.end());
+  BasicBlock *RootEntry = &Root->getEntryBlock();
+
+  // A value can be used in the isolated function only if it's defined by one
+  // of its members, or it's a local variable of the root function, which will
+  // be duplicated
+  auto IsAvailable = [&MemberSet, RootEntry] (Value *V) {
+    auto *I = dyn_cast<Instruction>(V);
+    if (I == nullptr)
+      return true;
+
+    BasicBlock *Parent = I->getParent();
+    return MemberSet.count(Parent) != 0
+      || (isa<AllocaInst>(I) && Parent == RootEntry);
+  };
+
+  for (BasicBlock *BB : Members) {
+    if (BB == RootEntry || isDispatcher(BB))
+      return false;
+
+    for (Instruction &I : *BB) {
+      // We can't return from the root function from within another function
+      if (isa<ReturnInst>(&I))
+        return false;
+
+      if (auto *Phi = dyn_cast<PHINode>(&I)) {
+        // Incoming values from basic blocks which are not members will be
+        // dropped, except for the one coming from the dispatcher, which will be
+        // used for the new predecessors
+        for (unsigned Index = 0; Index < Phi->getNumIncomingValues(); Index++) {
+          BasicBlock *Incoming = Phi->getIncomingBlock(Index);
+          if ((MemberSet.count(Incoming) != 0 || Incoming == JTM->dispatcher())
+              && !IsAvailable(Phi->getIncomingValue(Index)))
+            return false;
+        }
+      } else {
+        for (Value *Operand : I.operands())
+          if (!IsAvailable(Operand))
+            return false;
+      }
+    }
+
+    // When leaving the function we have to set the PC to the destination,
+    // which therefore must be a jump target. Also the callees need a PC.
+    bool IsCall = FunctionCalls.count(BB->getTerminator()) != 0;
+    for (BasicBlock *Successor : successors(BB)) {
+      if (isDispatcher(Successor)
+          || (!IsCall && MemberSet.count(Successor) != 0))
+        continue;
+
+      uint64_t PC = getBasicBlockPC(Successor);
+      if (PC == 0 || !JTM->isJumpTarget(PC))
+        return false;
+    }
+  }
+
+  return true;
+}
+
+void FunctionIsolator::createFunctionDispatcher() {
+  Module *TheModule = Root->getParent();
+  LLVMContext &Context = TheModule->getContext();
+  Value *PCReg = JTM->pcReg();
+  auto *PCType = cast<IntegerType>(PCReg->getType()->getPointerElementType());
+
+  auto *DispatcherType = FunctionType::get(Type::getVoidTy(Context), false);
+  FunctionDispatcher = Function::Create(DispatcherType,
+                                        GlobalValue::InternalLinkage,
+                                        "function_dispatcher",
+                                        TheModule);
+
+  BasicBlock *Entry = BasicBlock::Create(Context,
+                                         "entrypoint",
+                                         FunctionDispatcher);
+  BasicBlock *Return = BasicBlock::Create(Context,
+                                          "return",
+                                          FunctionDispatcher);
+  ReturnInst::Create(Context, Return);
+
+  // If the PC is not the entry point of an isolated function, just return:
+  // the caller will notice the PC is not the expected return address and
+  // return to the root function
+  IRBuilder<> Builder(Entry);
+  SwitchInst *Switch = Builder.CreateSwitch(Builder.CreateLoad(PCReg),
+                                            Return,
+                                            Isolated.size());
+
+  for (auto &P : Isolated) {
+    BasicBlock *CallBB = BasicBlock::Create(Context,
+                                            "call",
+                                            FunctionDispatcher,
+                                            Return);
+    Builder.SetInsertPoint(CallBB);
+    Builder.CreateCall(P.second);
+    Builder.CreateBr(Return);
+    Switch->addCase(ConstantInt::get(PCType, P.first), CallBB);
+  }
+}
+
+void FunctionIsolator::isolate(BasicBlock *Entry,
+                               const std::vector<BasicBlock *> &Members) {
+  Function *F = getFunctionAt(getBasicBlockPC(Entry));
+  assert(F != nullptr);
+
+  LLVMContext &Context = F->getContext();
+  Value *PCReg = JTM->pcReg();
+  auto *PCType = cast<IntegerType>(PCReg->getType()->getPointerElementType());
+  auto PC = [PCType] (uint64_t Address) {
+    return ConstantInt::get(PCType, Address);
+  };
+  BasicBlock *RootEntry = &Root->getEntryBlock();
+
+  ValueToValueMapTy VMap;
+  BasicBlock *EntryBB = BasicBlock::Create(Context, "entrypoint", F);
+  IRBuilder<> Builder(EntryBB);
+
+  // Duplicate the local variables of the root function
+  for (BasicBlock *BB : Members) {
+    for (Instruction &I : *BB) {
+      for (Value *Operand : I.operands()) {
+        auto *Alloca = dyn_cast<AllocaInst>(Operand);
+        if (Alloca != nullptr
+            && Alloca->getParent() == RootEntry
+            && VMap.count(Alloca) == 0)
+          VMap[Alloca] = Builder.Insert(Alloca->clone(), Alloca->getName());
+      }
+    }
+  }
+
+  // Clone all the members
+  std::map<BasicBlock *, BasicBlock *> Originals;
+  for (BasicBlock *BB : Members) {
+    BasicBlock *Clone = CloneBasicBlock(BB, VMap, "", F);
+    VMap[BB] = Clone;
+    Originals[Clone] = BB;
+  }
+
+  for (BasicBlock *BB : Members)
+    for (Instruction &I : *cast<BasicBlock>(VMap[BB]))
+      RemapInstruction(&I, VMap, RF_IgnoreMissingEntries);
+
+  // Basic block used to leave the function, the PC has already been set
+  BasicBlock *Unwind = BasicBlock::Create(Context, "unwind", F);
+  ReturnInst::Create(Context, Unwind);
+
+  // Basic blocks used to leave the function setting the PC to a jump target
+  // outside the function
+  std::map<BasicBlock *, BasicBlock *> Exits;
+  auto GetExit = [&] (BasicBlock *Target) -> BasicBlock * {
+    Value *Mapped = VMap.lookup(Target);
+    if (Mapped != nullptr)
+      return cast<BasicBlock>(Mapped);
+
+    if (isDispatcher(Target))
+      return Unwind;
+
+    BasicBlock *&Exit = Exits[Target];
+    if (Exit == nullptr) {
+      Exit = BasicBlock::Create(Context, "exit." + Target->getName(), F);
+      IRBuilder<> ExitBuilder(Exit);
+      ExitBuilder.CreateStore(PC(getBasicBlockPC(Target)), PCReg);
+      ExitBuilder.CreateRetVoid();
+    }
+
+    return Exit;
+  };
+
+  // Fix the terminators branching outside the function and lower function
+  // calls
+  for (BasicBlock *BB : Members) {
+    TerminatorInst *OriginalTerminator = BB->getTerminator();
+    auto *Terminator = cast<TerminatorInst>(VMap[OriginalTerminator]);
+    unsigned SuccessorsCount = Terminator->getNumSuccessors();
+
+    auto CallIt = FunctionCalls.find(OriginalTerminator);
+    if (CallIt == FunctionCalls.end()) {
+      for (unsigned I = 0; I < SuccessorsCount; I++)
+        Terminator->setSuccessor(I,
+                                 GetExit(OriginalTerminator->getSuccessor(I)));
+      continue;
+    }
+
+    BasicBlock *ReturnBB = CallIt->second;
+    BasicBlock *Return = GetExit(ReturnBB);
+    uint64_t ReturnPC = getBasicBlockPC(ReturnBB);
+
+    for (unsigned I = 0; I < SuccessorsCount; I++) {
+      BasicBlock *Successor = OriginalTerminator->getSuccessor(I);
+
+      // Not taking a conditional call
+      if (Successor == ReturnBB) {
+        Terminator->setSuccessor(I, Return);
+        continue;
+      }
+
+      BasicBlock *CallBB = BasicBlock::Create(Context, "call", F, Unwind);
+      Builder.SetInsertPoint(CallBB);
+
+      // Call the callee, if we know it, or let the function dispatcher find it
+      Function *Callee = FunctionDispatcher;
+      if (!isDispatcher(Successor)) {
+        uint64_t CalleePC = getBasicBlockPC(Successor);
+        Builder.CreateStore(PC(CalleePC), PCReg);
+        if (Function *IsolatedCallee = getFunctionAt(CalleePC))
+          Callee = IsolatedCallee;
+      }
+      Builder.CreateCall(Callee);
+
+      // Proceed only if we're at the expected return address
+      Value *IsExpected = Builder.CreateICmpEQ(Builder.CreateLoad(PCReg),
+                                               PC(ReturnPC));
+      Builder.CreateCondBr(IsExpected, Return, Unwind);
+
+      Terminator->setSuccessor(I, CallBB);
+    }
+  }
+
+  // Jump to the member associated to the current PC
+  Builder.SetInsertPoint(EntryBB);
+  SwitchInst *Switch = Builder.CreateSwitch(Builder.CreateLoad(PCReg), Unwind);
+  std::set<uint64_t> Cases;
+  for (BasicBlock *BB : Members) {
+    uint64_t BBPC = getBasicBlockPC(BB);
+    bool IsJumpTarget = BBPC != 0 && JTM->isJumpTarget(BBPC);
+    if (!(BB == Entry || IsJumpTarget) || !Cases.insert(BBPC).second)
+      continue;
+
+    Switch->addCase(PC(BBPC), cast<BasicBlock>(VMap[BB]));
+
+    // The first function containing a jump target will handle it in the root
+    // function
+    if (IsJumpTarget && Owners.count(BBPC) == 0)
+      Owners[BBPC] = { BB, F };
+  }
+
+  // Fix the PHI nodes: keep the incoming values from the members, and use the
+  // value coming from the dispatcher for the new predecessors
+  for (BasicBlock *BB : Members) {
+    auto *Clone = cast<BasicBlock>(VMap[BB]);
+
+    for (Instruction &I : *BB) {
+      auto *Phi = dyn_cast<PHINode>(&I);
+      if (Phi == nullptr)
+        break;
+
+      auto MapValue = [&VMap] (Value *V) {
+        Value *Mapped = VMap.lookup(V);
+        return Mapped != nullptr ? Mapped : V;
+      };
+
+      Value *Default = UndefValue::get(Phi->getType());
+      int DispatcherIndex = Phi->getBasicBlockIndex(JTM->dispatcher());
+      if (DispatcherIndex >= 0)
+        Default = MapValue(Phi->getIncomingValue(DispatcherIndex));
+
+      auto *NewPhi = cast<PHINode>(VMap[Phi]);
+      while (NewPhi->getNumIncomingValues() != 0)
+        NewPhi->removeIncomingValue(0u, false);
+
+      for (BasicBlock *Predecessor : predecessors(Clone)) {
+        Value *Incoming = Default;
+
+        auto It = Originals.find(Predecessor);
+        if (It != Originals.end()) {
+          int Index = Phi->getBasicBlockIndex(It->second);
+          if (Index >= 0)
+            Incoming = MapValue(Phi->getIncomingValue(Index));
+        }
+
+        NewPhi->addIncoming(Incoming, Predecessor);
+      }
+    }
+  }
+}
+
+void FunctionIsolator::redirectRoot() {
+  LLVMContext &Context = Root->getContext();
+  Value *PCReg = JTM->pcReg();
+  auto *PCType = cast<IntegerType>(PCReg->getType()->getPointerElementType());
+
+  // Owners is sorted by PC, which makes the order of the trampolines
+  // reproducible
+  for (auto &P : Owners) {
+    uint64_t TargetPC = P.first;
+    BasicBlock *Target = P.second.first;
+
+    // Set the PC, since the isolated function will use it to find where to
+    // start, call the function and resume from wherever it left
+    BasicBlock *Trampoline = BasicBlock::Create(Context,
+                                                "isolated." + Target->getName(),
+                                                Root);
+    IRBuilder<> Builder(Trampoline);
+    Builder.CreateStore(ConstantInt::get(PCType, TargetPC), PCReg);
+    Builder.CreateCall(P.second.second);
+    Builder.CreateBr(JTM->dispatcher());
+    JTM->replaceBlockAt(TargetPC, Trampoline);
+
+    // Collect the branches first, since we're going to change the users
+    std::set<TerminatorInst *> Branches;
+    for (User *U : Target->users())
+      if (auto *Branch = dyn_cast<TerminatorInst>(U))
+        Branches.insert(Branch);
+
+    for (TerminatorInst *Branch : Branches) {
+      for (unsigned I = 0; I < Branch->getNumSuccessors(); I++) {
+        if (Branch->getSuccessor(I) == Target) {
+          Target->removePredecessor(Branch->getParent());
+          Branch->setSuccessor(I, Trampoline);
+        }
+      }
+    }
+  }
+}
+
+void FunctionIsolator::purgeUnreachable() {
+  OnceQueue<BasicBlock *> WorkList;
+  WorkList.insert(&Root->getEntryBlock());
+  while (!WorkList.empty())
+    for (BasicBlock *Successor : successors(WorkList.pop()))
+      WorkList.insert(Successor);
+  std::set<BasicBlock *> Reachable = WorkList.visited();
+
+  // Unlike purgeDeadBlocks, this also handles dead loops, which are common
+  // once the functions have been moved out
+  std::vector<BasicBlock *> Dead;
+  for (BasicBlock &BB : *Root)
+    if (Reachable.count(&BB) == 0)
+      Dead.push_back(&BB);
+
+  for (BasicBlock *BB : Dead) {
+    // No jump target can be left pointing to a removed basic block
+    assert(getBasicBlockPC(BB) == 0
+           || !JTM->isJumpTarget(getBasicBlockPC(BB))
+           || JTM->getBlockAt(getBasicBlockPC(BB)) != BB);
+
+    for (BasicBlock *Successor : successors(BB))
+      if (Reachable.count(Successor) != 0)
+        Successor->removePredecessor(BB);
+    BB->dropAllReferences();
+  }
+
+  for (BasicBlock *BB : Dead)
+    BB->eraseFromParent();
+}
+
+unsigned FunctionIsolator::run() {
+  ScopedPhase Phase("IsolateFunctions");
+
+  Module *TheModule = Root->getParent();
+  LLVMContext &Context = TheModule->getContext();
+  auto *IsolatedType = FunctionType::get(Type::getVoidTy(Context), false);
+
+  // Sort the functions by address, for reproducibility, and create them all
+  // before populating them, so that the calls among them can be lowered
+  std::map<uint64_t, std::pair<BasicBlock *, const std::vector<BasicBlock *> *>>
+    ToIsolate;
+  for (auto &P : Functions) {
+    if (!isIsolable(P.first, P.second)) {
+      DBG("isolation", dbg << "Can't isolate " << getName(P.first) << "\n");
+      continue;
+    }
+
+    uint64_t PC = getBasicBlockPC(P.first);
+    ToIsolate[PC] = { P.first, &P.second };
+  }
+
+  for (auto &P : ToIsolate) {
+    std::stringstream Name;
+    Name << "function_0x" << std::hex << P.first;
+    Isolated[P.first] = Function::Create(IsolatedType,
+                                         GlobalValue::InternalLinkage,
+                                         Name.str(),
+                                         TheModule);
+  }
+
+  createFunctionDispatcher();
+
+  for (auto &P : ToIsolate)
+    isolate(P.second.first, *P.second.second);
+
+  redirectRoot();
+
+  purgeUnreachable();
+
+  DBG("isolation", dbg << "Isolated " << std::dec << Isolated.size()
+                       << " functions out of " << Functions.size() << "\n");
+
+  return Isolated.size();
+}
@@ -0,0 +1,113 @@
+#ifndef _ISOLATEFUNCTIONS_H
+#define _ISOLATEFUNCTIONS_H
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace llvm {
+class BasicBlock;
+class Function;
+class TerminatorInst;
+}
+
+class JumpTargetManager;
+
+/// \brief Move each detected function out of the root function into an LLVM
+///        function of its own
+///
+/// Each isolated function starts with a switch on the PC, jumping to the basic
+/// block associated to each of the jump targets it contains. Function calls are
+/// lowered to actual calls followed by a check that the PC is the expected
+/// return address. Whenever the control flow leaves the function in any other
+/// way (indirect jumps, jumps to basic blocks of other functions, unexpected
+/// return addresses) the function returns: the CPU state is in global
+/// variables, so the dispatcher of the root function can resume the execution
+/// from the current PC.
+///
+/// In the root function, all the branches to the jump targets part of an
+/// isolated function are replaced with a call to such function, so that most
+/// of its code becomes dead and can be removed.
+class FunctionIsolator {
+public:
+  using FunctionsMap = std::map<llvm::BasicBlock *,
+                                std::vector<llvm::BasicBlock *>>;
+  using FunctionCallsMap = std::map<llvm::TerminatorInst *, llvm::BasicBlock *>;
+
+  /// \param Root the function containing all the translated code.
+  /// \param JTM the JumpTargetManager associated to \p Root.
+  /// \param Functions the functions to isolate, as detected by the
+  ///        FunctionBoundariesDetectionPass.
+  /// \param FunctionCalls the function calls detected by the
+  ///        FunctionBoundariesDetectionPass.
+  FunctionIsolator(llvm::Function *Root,
+                   JumpTargetManager *JTM,
+                   const FunctionsMap &Functions,
+                   const FunctionCallsMap &FunctionCalls) :
+    Root(Root),
+    JTM(JTM),
+    Functions(Functions),
+    FunctionCalls(FunctionCalls),
+    FunctionDispatcher(nullptr) { }
+
+  /// \brief Perform the isolation
+  ///
+  /// \return the number of isolated functions.
+  unsigned run();
+
+private:
+  /// \brief Check that all the members of a function can be moved out of the
+  ///        root function
+  bool isIsolable(llvm::BasicBlock *Entry,
+                  const std::vector<llvm::BasicBlock *> &Members) const;
+
+  /// \brief Create the function calling the isolated function associated to
+  ///        the current value of the PC, if any
+  void createFunctionDispatcher();
+
+  /// \brief Populate the body of the isolated function for \p Entry
+  void isolate(llvm::BasicBlock *Entry,
+               const std::vector<llvm::BasicBlock *> &Members);
+
+  /// \brief Replace all the branches in the root function to a jump target
+  ///        part of an isolated function with a call to it
+  ///
+  /// The JumpTargetManager associates each of these jump targets to the basic
+  /// block performing the call (the trampoline), since the original one is
+  /// going to be removed.
+  void redirectRoot();
+
+  /// \brief Remove all the basic blocks of the root function which are no
+  ///        longer reachable
+  void purgeUnreachable();
+
+  /// \brief Return the isolated function starting at \p PC, if any
+  llvm::Function *getFunctionAt(uint64_t PC) const {
+    auto It = Isolated.find(PC);
+    return It == Isolated.end() ? nullptr : It->second;
+  }
+
+  bool isDispatcher(llvm::BasicBlock *BB) const;
+
+private:
+  llvm::Function *Root;
+  JumpTargetManager *JTM;
+  const FunctionsMap &Functions;
+  const FunctionCallsMap &FunctionCalls;
+
+  /// Isolated functions by entry PC
+  std::map<uint64_t, llvm::Function *> Isolated;
+
+  /// Basic block of the root function associated to each jump target part of
+  /// an isolated function, and the function to call to enter it, by PC
+  std::map<uint64_t, std::pair<llvm::BasicBlock *, llvm::Function *>> Owners;
+
+  llvm::Function *FunctionDispatcher;
+};
+
+#endif // _ISOLATEFUNCTIONS_H
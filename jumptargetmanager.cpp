@@ -8,25 +8,34 @@
 //
 
 // Standard includes
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <fstream>
+#include <future>
+#include <limits>
 #include <queue>
 #include <sstream>
+#include <thread>
 #include <boost/icl/interval_set.hpp>
 #include <boost/type_traits/is_same.hpp>
 #include <boost/icl/right_open_interval.hpp>
 
 // LLVM includes
 #include "llvm/ADT/Optional.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/Support/Endian.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
 
 // Local includes
 #include "datastructures.h"
@@ -34,8 +43,10 @@
 #include "revamb.h"
 #include "ir-helpers.h"
 #include "jumptargetmanager.h"
+#include "profile.h"
 #include "set.h"
 #include "simplifycomparisons.h"
+#include "timereport.h"
 
 using namespace llvm;
 
@@ -54,7 +65,10 @@ static RegisterPass<TranslateDirectBranchesPass> X("translate-db",
                                                    false);
 
 void TranslateDirectBranchesPass::getAnalysisUsage(AnalysisUsage &AU) const {
-  AU.addRequired<DominatorTreeWrapperPass>();
+  // The dominator tree is only needed by getNextPC, avoid recomputing it on
+  // the whole function at each round of an incremental harvesting
+  if (JTM == nullptr || !JTM->isIncrementalHarvest())
+    AU.addRequired<DominatorTreeWrapperPass>();
   AU.addUsedIfAvailable<SETPass>();
 }
 
@@ -89,7 +103,23 @@ bool TranslateDirectBranchesPass::pinJTs(Function &F) {
   for (const auto &Jump : SET->jumps()) {
     StoreInst *PCWrite = Jump.Instruction;
     bool Approximate = Jump.Approximate;
-    const std::vector<uint64_t> &Destinations = Jump.Destinations;
+
+    // Consider only the destinations which are jump targets, each of them
+    // once, since they will become cases of a switch
+    std::vector<uint64_t> Destinations;
+    Destinations.reserve(Jump.Destinations.size());
+    for (uint64_t Destination : Jump.Destinations) {
+      if (JTM->isJumpTarget(Destination))
+        Destinations.push_back(Destination);
+      else
+        Approximate = true;
+    }
+    std::sort(Destinations.begin(), Destinations.end());
+    auto Last = std::unique(Destinations.begin(), Destinations.end());
+    Destinations.erase(Last, Destinations.end());
+
+    if (Destinations.size() == 0)
+      continue;
 
     // We don't care if we already handled this call too exitTB in the past,
     // information should become progressively more precise, so let's just
@@ -108,7 +138,11 @@ bool TranslateDirectBranchesPass::pinJTs(Function &F) {
     // TODO: we should check Destinations.size() >= OldTargetsCount
     // TODO: we should also check the destinations are actually the same
 
-    BasicBlock *FailBB = Approximate ? Dispatcher : Dispatcher /* Fail */;
+    // Jump directly to the destinations, going through the dispatcher only if
+    // the PC is not among them. If the destinations are exhaustive this
+    // should never happen, but the dispatcher still handles it gracefully, by
+    // reaching DispatcherFail, in case the analysis has been too optimistic.
+    BasicBlock *FailBB = Dispatcher;
     BasicBlock *BB = CallExitTB->getParent();
 
     // Kill everything is after the call to exitTB
@@ -116,6 +150,7 @@ bool TranslateDirectBranchesPass::pinJTs(Function &F) {
 
     // Mark this call to exitTB as handled
     CallExitTB->setArgOperand(0, ExitTBArg);
+    JTM->markLocalDispatch(CallExitTB);
 
     IRBuilder<> Builder(BB);
     auto PCLoad = Builder.CreateLoad(PCReg);
@@ -130,6 +165,11 @@ bool TranslateDirectBranchesPass::pinJTs(Function &F) {
         Switch->addCase(C(Destination), JTM->getBlockAt(Destination));
     }
 
+    DBG("localdispatch", dbg << "Jump at " << getName(PCWrite) << " has "
+                             << std::dec << Destinations.size()
+                             << (Approximate ? " approximate" : " exhaustive")
+                             << " destinations\n");
+
     // Notify new branches only if the amount of possible targets actually
     // increased
     if (Destinations.size() > OldTargetsCount)
@@ -269,6 +309,7 @@ bool TranslateDirectBranchesPass::forceFallthroughAfterHelper(CallInst *Call) {
 }
 
 bool TranslateDirectBranchesPass::runOnFunction(Function &F) {
+  ScopedPhase Phase("harvest.TranslateDirectBranches");
   pinConstantStore(F);
   pinJTs(F);
   return true;
@@ -309,50 +350,92 @@ uint64_t TranslateDirectBranchesPass::getNextPC(Instruction *TheInstruction) {
   llvm_unreachable("Can't find the PC marker");
 }
 
+template<typename T, support::endianness E>
+static uint64_t readValue(const unsigned char *Start) {
+  return support::endian::read<T, E, 1>(Start);
+}
+
+void JumpTargetManager::createSegmentsTable() {
+  // Note: we also consider writeable memory areas because, despite being
+  // modifiable, can contain useful information
+  for (auto &Segment : Segments) {
+    if (!Segment.IsReadable)
+      continue;
+
+    ReadableSegment Entry;
+    Entry.StartVirtualAddress = Segment.StartVirtualAddress;
+    Entry.EndVirtualAddress = Segment.EndVirtualAddress;
+    Entry.Data = Segment.Data;
+    ReadableSegments.push_back(Entry);
+  }
+
+  std::sort(ReadableSegments.begin(),
+            ReadableSegments.end(),
+            [] (const ReadableSegment &A, const ReadableSegment &B) {
+              return A.StartVirtualAddress < B.StartVirtualAddress;
+            });
+
+  using support::endianness;
+  Readers[0] = &readValue<uint8_t, endianness::little>;
+  if (TheModule.getDataLayout().isLittleEndian()) {
+    Readers[1] = &readValue<uint16_t, endianness::little>;
+    Readers[2] = &readValue<uint32_t, endianness::little>;
+    Readers[3] = &readValue<uint64_t, endianness::little>;
+  } else {
+    Readers[1] = &readValue<uint16_t, endianness::big>;
+    Readers[2] = &readValue<uint32_t, endianness::big>;
+    Readers[3] = &readValue<uint64_t, endianness::big>;
+  }
+}
+
 Optional<uint64_t> JumpTargetManager::readRawValue(uint64_t Address,
                                                    unsigned Size) const {
   assert(Size <= 8 * sizeof(uint64_t));
 
-  // TODO: create a IsLittleEndian field in JumpTargetManager?
-  const DataLayout &DL = TheModule.getDataLayout();
-
-  for (auto &Segment : Segments) {
-    // Note: we also consider writeable memory areas because, despite being
-    // modifiable, can contain useful information
-    if (Segment.contains(Address, Size) && Segment.IsReadable) {
-      auto *Array = cast<ConstantDataArray>(Segment.Variable->getInitializer());
-      StringRef RawData = Array->getRawDataValues();
-      const unsigned char *RawDataPtr = RawData.bytes_begin();
-      uint64_t Offset = Address - Segment.StartVirtualAddress;
-      const unsigned char *Start = RawDataPtr + Offset;
-
-      using support::endian::read;
-      using support::endianness;
-      switch (Size) {
-      case 1:
-        return read<uint8_t, endianness::little, 1>(Start);
-      case 2:
-        if (DL.isLittleEndian())
-          return read<uint16_t, endianness::little, 1>(Start);
-        else
-          return read<uint16_t, endianness::big, 1>(Start);
-      case 4:
-        if (DL.isLittleEndian())
-          return read<uint32_t, endianness::little, 1>(Start);
-        else
-          return read<uint32_t, endianness::big, 1>(Start);
-      case 8:
-        if (DL.isLittleEndian())
-          return read<uint64_t, endianness::little, 1>(Start);
-        else
-          return read<uint64_t, endianness::big, 1>(Start);
-      default:
-        assert(false && "Unexpected read size");
-      }
-    }
+  ReadFunction Reader = nullptr;
+  switch (Size) {
+  case 1:
+    Reader = Readers[0];
+    break;
+  case 2:
+    Reader = Readers[1];
+    break;
+  case 4:
+    Reader = Readers[2];
+    break;
+  case 8:
+    Reader = Readers[3];
+    break;
+  default:
+    assert(false && "Unexpected read size");
+    return Optional<uint64_t>();
   }
 
-  return Optional<uint64_t>();
+  // Find the last segment starting before Address. Segments do not overlap,
+  // therefore it's the only one which could contain it.
+  auto It = std::upper_bound(ReadableSegments.begin(),
+                             ReadableSegments.end(),
+                             Address,
+                             [] (uint64_t Address, const ReadableSegment &S) {
+                               return Address < S.StartVirtualAddress;
+                             });
+  if (It == ReadableSegments.begin())
+    return Optional<uint64_t>();
+  --It;
+
+  if (Address + Size > It->EndVirtualAddress)
+    return Optional<uint64_t>();
+
+  // Fast path: the value is entirely in the data from the input file
+  uint64_t Offset = Address - It->StartVirtualAddress;
+  if (Offset + Size <= It->Data.size())
+    return Reader(It->Data.data() + Offset);
+
+  // Part of the value (or all of it) is in the zero-filled part of the segment
+  unsigned char Buffer[sizeof(uint64_t)] = { 0 };
+  for (unsigned I = 0; I < Size && Offset + I < It->Data.size(); I++)
+    Buffer[I] = It->Data[Offset + I];
+  return Reader(Buffer);
 }
 
 Constant *JumpTargetManager::readConstantPointer(Constant *Address,
@@ -398,7 +481,8 @@ JumpTargetManager::JumpTargetManager(Function *TheFunction,
                                      Value *PCReg,
                                      Architecture& SourceArchitecture,
                                      std::vector<SegmentInfo>& Segments,
-                                     bool EnableOSRA) :
+                                     bool EnableOSRA,
+                                     bool IncrementalHarvest) :
   TheModule(*TheFunction->getParent()),
   Context(TheModule.getContext()),
   TheFunction(TheFunction),
@@ -411,16 +495,37 @@ JumpTargetManager::JumpTargetManager(Function *TheFunction,
   Segments(Segments),
   SourceArchitecture(SourceArchitecture),
   EnableOSRA(EnableOSRA),
+  IncrementalHarvest(IncrementalHarvest),
+  HarvestTime(std::chrono::steady_clock::duration::zero()),
   NoReturn(SourceArchitecture) {
   FunctionType *ExitTBTy = FunctionType::get(Type::getVoidTy(Context),
                                              { Type::getInt32Ty(Context) },
                                              false);
   ExitTB = cast<Function>(TheModule.getOrInsertFunction("exitTB", ExitTBTy));
+  LocalDispatchMDKind = Context.getMDKindID("revamb.localdispatch");
   createDispatcher(TheFunction, PCReg, true);
 
+  createSegmentsTable();
+
   for (auto& Segment : Segments)
     Segment.insertExecutableRanges(std::back_inserter(ExecutableRanges));
 
+  // Sort and coalesce the executable ranges, so that they can be looked up
+  // with a binary search
+  std::sort(ExecutableRanges.begin(), ExecutableRanges.end());
+  RangesVector Coalesced;
+  for (std::pair<uint64_t, uint64_t> Range : ExecutableRanges) {
+    if (Range.first >= Range.second)
+      continue;
+
+    if (!Coalesced.empty() && Range.first <= Coalesced.back().second)
+      Coalesced.back().second = std::max(Coalesced.back().second,
+                                         Range.second);
+    else
+      Coalesced.push_back(Range);
+  }
+  ExecutableRanges = std::move(Coalesced);
+
   // Configure GlobalValueNumbering
   StringMap<cl::Option *>& Options(cl::getRegisteredOptions());
   getOption<bool>(Options, "enable-load-pre")->setInitialValue(false);
@@ -429,32 +534,175 @@ JumpTargetManager::JumpTargetManager(Function *TheFunction,
   // getOption<uint32_t>(Options, "max-recurse-depth")->setInitialValue(10);
 }
 
-void JumpTargetManager::harvestGlobalData() {
+void JumpTargetManager::harvestGlobalData(const RangesVector *Ranges) {
+  ScopedPhase Phase("harvestGlobalData");
+  using endianness = support::endianness;
+
+  if (ExecutableRanges.empty())
+    return;
+
+  // Candidates are first checked against the boundaries of the executable
+  // ranges and the instruction alignment, without branches, so that the
+  // compiler can vectorize the check. Only the hits go through the (expensive)
+  // registerJT, which performs the precise checks.
+  CodePointerFilter Filter;
+  Filter.Low = ExecutableRanges.front().first;
+  Filter.Span = ExecutableRanges.back().second - Filter.Low;
+  const uint64_t Alignment = SourceArchitecture.instructionAlignment();
+  const bool IsPowerOfTwo = Alignment != 0
+                            && (Alignment & (Alignment - 1)) == 0;
+  Filter.AlignmentMask = IsPowerOfTwo ? Alignment - 1 : 0;
+
+  using ScanFunction = void (*)(const CodePointerFilter &,
+                                const unsigned char *,
+                                const unsigned char *,
+                                uint64_t,
+                                std::vector<CodePointer> &);
+  ScanFunction Scan = nullptr;
+  unsigned PointerSize = 0;
+  if (SourceArchitecture.pointerSize() == 64) {
+    PointerSize = sizeof(uint64_t);
+    if (SourceArchitecture.isLittleEndian())
+      Scan = &findCodePointers<uint64_t, endianness::little>;
+    else
+      Scan = &findCodePointers<uint64_t, endianness::big>;
+  } else if (SourceArchitecture.pointerSize() == 32) {
+    PointerSize = sizeof(uint32_t);
+    if (SourceArchitecture.isLittleEndian())
+      Scan = &findCodePointers<uint32_t, endianness::little>;
+    else
+      Scan = &findCodePointers<uint32_t, endianness::big>;
+  } else {
+    return;
+  }
+
+  // Split each segment in chunks, each one to be scanned independently. The
+  // chunks are relative to the data available in the input file, the
+  // (zero-filled) rest of the segment is handled on the main thread.
+  struct ScanTask {
+    uint64_t StartVirtualAddress;
+    uint64_t Offset;
+    const unsigned char *Start;
+    const unsigned char *End;
+    std::vector<CodePointer> Candidates;
+  };
+  const uint64_t ChunkSize = 1 << 20;
+  std::vector<ScanTask> Tasks;
+
   for (auto& Segment : Segments) {
-    auto *Data = cast<ConstantDataArray>(Segment.Variable->getInitializer());
-    uint64_t StartVirtualAddress = Segment.StartVirtualAddress;
-    const unsigned char *DataStart = Data->getRawDataValues().bytes_begin();
-    const unsigned char *DataEnd = Data->getRawDataValues().bytes_end();
-
-    using endianness = support::endianness;
-    if (SourceArchitecture.pointerSize() == 64) {
-      if (SourceArchitecture.isLittleEndian())
-        findCodePointers<uint64_t, endianness::little>(StartVirtualAddress,
-                                                       DataStart,
-                                                       DataEnd);
-      else
-        findCodePointers<uint64_t, endianness::big>(StartVirtualAddress,
-                                                    DataStart,
-                                                    DataEnd);
-    } else if (SourceArchitecture.pointerSize() == 32) {
-      if (SourceArchitecture.isLittleEndian())
-        findCodePointers<uint32_t, endianness::little>(StartVirtualAddress,
-                                                       DataStart,
-                                                       DataEnd);
-      else
-        findCodePointers<uint32_t, endianness::big>(StartVirtualAddress,
-                                                    DataStart,
-                                                    DataEnd);
+    uint64_t Size = Segment.EndVirtualAddress - Segment.StartVirtualAddress;
+    if (Size <= PointerSize)
+      continue;
+
+    // Consider all the offsets up to Last (excluded)
+    const uint64_t Last = Size - PointerSize;
+    const uint64_t FileSize = Segment.Data.size();
+    const unsigned char *Data = Segment.Data.data();
+
+    // Offsets whose value is entirely in the file
+    uint64_t FileLast = 0;
+    if (FileSize >= PointerSize)
+      FileLast = FileSize - PointerSize + 1;
+    FileLast = std::min(FileLast, Last);
+
+    // Windows of offsets to scan: all of them, or the ones of the values
+    // overlapping the requested ranges
+    RangesVector Windows;
+    if (Ranges == nullptr) {
+      Windows.push_back({ 0, Last });
+    } else {
+      const uint64_t SegmentStart = Segment.StartVirtualAddress;
+      for (auto &Range : *Ranges) {
+        if (Range.second <= SegmentStart
+            || Range.first >= Segment.EndVirtualAddress)
+          continue;
+
+        uint64_t Begin = 0;
+        if (Range.first > SegmentStart + PointerSize - 1)
+          Begin = Range.first - (PointerSize - 1) - SegmentStart;
+        uint64_t End = std::min(Range.second - SegmentStart, Last);
+
+        // The ranges are sorted, avoid scanning twice the same offsets
+        if (!Windows.empty())
+          Begin = std::max(Begin, Windows.back().second);
+        if (Begin < End)
+          Windows.push_back({ Begin, End });
+      }
+    }
+
+    for (auto &Window : Windows) {
+      const uint64_t Begin = Window.first;
+      const uint64_t End = Window.second;
+
+      const uint64_t InFileEnd = std::min(End, FileLast);
+      for (uint64_t Offset = Begin; Offset < InFileEnd; Offset += ChunkSize) {
+        ScanTask Task;
+        Task.StartVirtualAddress = Segment.StartVirtualAddress;
+        Task.Offset = Offset;
+        Task.Start = Data + Offset;
+        Task.End = Data + std::min(Offset + ChunkSize, InFileEnd);
+        Tasks.push_back(std::move(Task));
+      }
+
+      if (End <= FileLast)
+        continue;
+
+      // Offsets whose value straddles the end of the file data
+      ScanTask Tail;
+      Tail.StartVirtualAddress = Segment.StartVirtualAddress;
+      Tail.Offset = FileLast;
+      Tail.Start = Tail.End = nullptr;
+      uint64_t StraddlingBegin = std::max(Begin, FileLast);
+      uint64_t StraddlingEnd = std::min(std::min(FileSize, Last), End);
+      if (StraddlingEnd > StraddlingBegin) {
+        uint64_t Straddling = StraddlingEnd - StraddlingBegin;
+        std::vector<unsigned char> Buffer(Straddling + PointerSize, 0);
+        std::copy(Data + StraddlingBegin, Data + FileSize, Buffer.begin());
+        Scan(Filter,
+             Buffer.data(),
+             Buffer.data() + Straddling,
+             StraddlingBegin,
+             Tail.Candidates);
+      }
+
+      // Offsets whose value is made of zeros only
+      uint64_t ZeroStart = std::max(std::max(FileLast, FileSize), Begin);
+      uint64_t ZeroEnd = std::min(Last, End);
+      if (ZeroStart < ZeroEnd && Filter.Low == 0 && Filter.Span > 0)
+        for (uint64_t Offset = ZeroStart; Offset < ZeroEnd; Offset++)
+          Tail.Candidates.push_back({ Offset, 0 });
+
+      Tasks.push_back(std::move(Tail));
+    }
+  }
+
+  // Collect the candidates on a pool of workers
+  std::atomic<size_t> NextTask(0);
+  auto Worker = [&Tasks, &NextTask, &Filter, Scan] () {
+    size_t Index;
+    while ((Index = NextTask++) < Tasks.size()) {
+      ScanTask &Task = Tasks[Index];
+      if (Task.Start != Task.End)
+        Scan(Filter, Task.Start, Task.End, Task.Offset, Task.Candidates);
+    }
+  };
+
+  size_t WorkersCount = std::max(1U, std::thread::hardware_concurrency());
+  WorkersCount = std::min(WorkersCount, Tasks.size());
+  std::vector<std::future<void>> Workers;
+  for (size_t I = 1; I < WorkersCount; I++)
+    Workers.push_back(std::async(std::launch::async, Worker));
+  Worker();
+  for (std::future<void> &W : Workers)
+    W.get();
+
+  // Register the candidates in order, on the main thread
+  for (ScanTask &Task : Tasks) {
+    for (CodePointer &Candidate : Task.Candidates) {
+      BasicBlock *Result = registerJT(Candidate.second, GlobalData);
+
+      if (Result != nullptr)
+        UnusedCodePointers.insert(Task.StartVirtualAddress + Candidate.first);
     }
   }
 
@@ -464,19 +712,36 @@ void JumpTargetManager::harvestGlobalData() {
 }
 
 template<typename value_type, unsigned endian>
-void JumpTargetManager::findCodePointers(uint64_t StartVirtualAddress,
+void JumpTargetManager::findCodePointers(const CodePointerFilter &Filter,
                                          const unsigned char *Start,
-                                         const unsigned char *End) {
+                                         const unsigned char *End,
+                                         uint64_t Offset,
+                                         std::vector<CodePointer> &Candidates) {
   using support::endian::read;
   using support::endianness;
-  for (auto Pos = Start; Pos < End - sizeof(value_type); Pos++) {
-    uint64_t Value = read<value_type,
-                          static_cast<endianness>(endian),
-                          1>(Pos);
-    BasicBlock *Result = registerJT(Value, GlobalData);
-
-    if (Result != nullptr)
-      UnusedCodePointers.insert(StartVirtualAddress + (Pos - Start));
+
+  const unsigned ChunkSize = 256;
+  uint8_t Hits[ChunkSize];
+  for (auto Chunk = Start; Chunk < End; Chunk += ChunkSize) {
+    unsigned Count = std::min<ptrdiff_t>(ChunkSize, End - Chunk);
+
+    for (unsigned I = 0; I < Count; I++) {
+      uint64_t Value = read<value_type,
+                            static_cast<endianness>(endian),
+                            1>(Chunk + I);
+      Hits[I] = (Value - Filter.Low < Filter.Span)
+        & ((Value & Filter.AlignmentMask) == 0);
+    }
+
+    for (unsigned I = 0; I < Count; I++) {
+      if (!Hits[I])
+        continue;
+
+      uint64_t Value = read<value_type,
+                            static_cast<endianness>(endian),
+                            1>(Chunk + I);
+      Candidates.push_back({ Offset + (Chunk + I - Start), Value });
+    }
   }
 }
 
@@ -497,18 +762,11 @@ BasicBlock *JumpTargetManager::newPC(uint64_t PC, bool& ShouldContinue) {
   auto JTIt = JumpTargets.find(PC);
   if (JTIt != JumpTargets.end()) {
     // If it was planned to explore it in the future, just to do it now
-    for (auto UnexploredIt = Unexplored.begin();
-         UnexploredIt != Unexplored.end();
-         UnexploredIt++) {
-
-      if (UnexploredIt->first == PC) {
-        auto Result = UnexploredIt->second;
-        Unexplored.erase(UnexploredIt);
-        ShouldContinue = true;
-        assert(Result->empty());
-        return Result;
-      }
-
+    BasicBlock *Result = nullptr;
+    if (Unexplored.erase(PC, Result)) {
+      ShouldContinue = true;
+      assert(Result->empty());
+      return Result;
     }
 
     // It wasn't planned to visit it, so we've already been there, just jump
@@ -974,9 +1232,14 @@ void JumpTargetManager::collectBBSummary(std::string OutputPath) {
 
 }
 
-void JumpTargetManager::translateIndirectJumps() {
+void JumpTargetManager::markLocalDispatch(CallInst *ExitTBCall) {
+  ExitTBCall->setMetadata(LocalDispatchMDKind, MDNode::get(Context, { }));
+}
+
+unsigned JumpTargetManager::translateIndirectJumps() {
+  unsigned LocalDispatchJumps = 0;
   if (ExitTB->use_empty())
-    return;
+    return LocalDispatchJumps;
 
   auto I = ExitTB->use_begin();
   while (I != ExitTB->use_end()) {
@@ -993,15 +1256,20 @@ void JumpTargetManager::translateIndirectJumps() {
         if (PCWrite != nullptr && EnableOSRA && isSumJump(PCWrite))
           handleSumJump(PCWrite);
 
+        // If nobody handled this jump, go through the dispatcher
         if (getLimitedValue(Call->getArgOperand(0)) == 0) {
           exitTBCleanup(Call);
           BranchInst::Create(Dispatcher, Call);
+        } else if (Call->getMetadata(LocalDispatchMDKind) != nullptr) {
+          LocalDispatchJumps++;
         }
 
         Call->eraseFromParent();
       }
     }
   }
+
+  return LocalDispatchJumps;
 }
 
 JumpTargetManager::BlockWithAddress JumpTargetManager::peek() {
@@ -1009,11 +1277,11 @@ JumpTargetManager::BlockWithAddress JumpTargetManager::peek() {
 
   if (Unexplored.empty())
     return NoMoreTargets;
-  else {
-    BlockWithAddress Result = Unexplored.back();
-    Unexplored.pop_back();
-    return Result;
-  }
+
+  BlockWithAddress Result = Unexplored.pop();
+  if (IncrementalHarvest)
+    LiftedBlocks.push_back(WeakVH(Result.second));
+  return Result;
 }
 
 void JumpTargetManager::unvisit(BasicBlock *BB) {
@@ -1047,11 +1315,21 @@ BasicBlock *JumpTargetManager::getBlockAt(uint64_t PC) {
   return TargetIt->second.head();
 }
 
+void JumpTargetManager::replaceBlockAt(uint64_t PC, BasicBlock *BB) {
+  auto TargetIt = JumpTargets.find(PC);
+  assert(TargetIt != JumpTargets.end());
+  auto Reasons = static_cast<JTReason>(TargetIt->second.getReasons());
+  TargetIt->second = JumpTarget(BB, Reasons);
+  SortedJumpTargetsDirty = true;
+}
+
 // TODO: register Reason
 BasicBlock *JumpTargetManager::registerJT(uint64_t PC, JTReason Reason) {
   if (!isExecutableAddress(PC) || !isInstructionAligned(PC))
     return nullptr;
 
+  SortedJumpTargetsDirty = true;
+
   // Do we already have a BasicBlock for this PC?
   BlockMap::iterator TargetIt = JumpTargets.find(PC);
   if (TargetIt != JumpTargets.end()) {
@@ -1080,11 +1358,16 @@ BasicBlock *JumpTargetManager::registerJT(uint64_t PC, JTReason Reason) {
       NewBlock = ContainingBlock->splitBasicBlock(InstrIt->second);
     }
     unvisit(NewBlock);
+
+    if (IncrementalHarvest) {
+      SplitBlocks.push_back(WeakVH(ContainingBlock));
+      SplitBlocks.push_back(WeakVH(NewBlock));
+    }
   } else {
     // Case 3: the address has never been met, create a temporary one, register
     // it for future exploration and return it
     NewBlock = BasicBlock::Create(Context, "", TheFunction);
-    Unexplored.push_back(BlockWithAddress(PC, NewBlock));
+    Unexplored.push(PC, NewBlock);
   }
 
   if (NewBlock->getName().empty()) {
@@ -1108,8 +1391,8 @@ void JumpTargetManager::registerReadRange(uint64_t Address, uint64_t Size) {
   ReadIntervalSet += interval::right_open(Address, Address + Size);
 }
 
-// TODO: instead of a gigantic switch case we could map the original memory area
-//       and write the address of the translated basic block at the jump target
+// Note: this function creates a switch with a case for each jump target,
+//       createDispatcherTables can later move most of them in lookup tables
 // If this function looks weird it's because it has been designed to be able
 // to create the dispatcher in the "root" function or in a standalone function
 void JumpTargetManager::createDispatcher(Function *OutputFunction,
@@ -1145,6 +1428,413 @@ void JumpTargetManager::createDispatcher(Function *OutputFunction,
   NoReturn.setDispatcher(Dispatcher);
 }
 
+void JumpTargetManager::applyProfile(const ExecutionProfile &Profile) {
+  ScopedPhase Phase("applyProfile");
+
+  // Branch weights are 32-bit, scale the counters down if necessary. Zero
+  // weights are not allowed.
+  uint64_t Max = 0;
+  for (auto &P : Profile.hits())
+    Max = std::max(Max, P.second);
+  unsigned Shift = 0;
+  while ((Max >> Shift) >= std::numeric_limits<uint32_t>::max())
+    Shift++;
+  auto Weight = [Shift] (uint64_t Count) -> uint32_t {
+    return (Count >> Shift) + 1;
+  };
+
+  MDBuilder MDB(Context);
+
+  // Rebuild the dispatcher with the hottest jump targets first
+  using Case = std::pair<ConstantInt *, BasicBlock *>;
+  std::vector<std::pair<uint64_t, Case>> Cases;
+  for (auto &C : DispatcherSwitch->cases()) {
+    ConstantInt *CaseValue = C.getCaseValue();
+    uint64_t Hits = Profile.hits(CaseValue->getZExtValue());
+    Cases.push_back({ Hits, { CaseValue, C.getCaseSuccessor() } });
+  }
+
+  std::stable_sort(Cases.begin(),
+                   Cases.end(),
+                   [] (const std::pair<uint64_t, Case> &A,
+                       const std::pair<uint64_t, Case> &B) {
+                     return A.first > B.first;
+                   });
+
+  SwitchInst *Sorted = SwitchInst::Create(DispatcherSwitch->getCondition(),
+                                          DispatcherFail,
+                                          Cases.size(),
+                                          DispatcherSwitch);
+  std::vector<uint32_t> Weights { Weight(0) };
+  for (auto &P : Cases) {
+    Sorted->addCase(P.second.first, P.second.second);
+    Weights.push_back(Weight(P.first));
+  }
+  Sorted->setMetadata(LLVMContext::MD_prof, MDB.createBranchWeights(Weights));
+  DispatcherSwitch->eraseFromParent();
+  DispatcherSwitch = Sorted;
+
+  // Move the hottest jump targets right after the dispatcher, so that they
+  // are close to each other in the output
+  std::vector<std::pair<uint64_t, BasicBlock *>> Hot;
+  for (auto &P : *this) {
+    uint64_t Hits = Profile.hits(P.first);
+    if (Hits != 0)
+      Hot.push_back({ Hits, P.second.head() });
+  }
+
+  std::stable_sort(Hot.begin(),
+                   Hot.end(),
+                   [] (const std::pair<uint64_t, BasicBlock *> &A,
+                       const std::pair<uint64_t, BasicBlock *> &B) {
+                     return A.first > B.first;
+                   });
+
+  BasicBlock *InsertionPoint = DispatcherFail;
+  for (auto &P : Hot) {
+    P.second->moveAfter(InsertionPoint);
+    InsertionPoint = P.second;
+  }
+
+  // Find the jump target whose code contains BB, following the unique
+  // predecessors
+  auto JumpTargetOf = [this] (BasicBlock *BB) -> uint64_t {
+    std::set<BasicBlock *> Visited;
+    while (BB != nullptr && Visited.insert(BB).second) {
+      uint64_t PC = getBasicBlockPC(BB);
+      if (PC != 0 && isJumpTarget(PC) && getBlockAt(PC) == BB)
+        return PC;
+      BB = BB->getSinglePredecessor();
+    }
+
+    return 0;
+  };
+
+  // Annotate the branches whose successors are all jump targets. If we know
+  // which jump target we're in use the edge counters, otherwise how many times
+  // each successor has been reached overall.
+  unsigned Annotated = 0;
+  for (BasicBlock &BB : *TheFunction) {
+    TerminatorInst *T = BB.getTerminator();
+    if (T == nullptr
+        || T == DispatcherSwitch
+        || T->getNumSuccessors() < 2
+        || !(isa<BranchInst>(T) || isa<SwitchInst>(T)))
+      continue;
+
+    uint64_t From = JumpTargetOf(&BB);
+    std::vector<uint32_t> BranchWeights;
+    bool AllJumpTargets = true;
+    bool Reached = false;
+    for (BasicBlock *Successor : T->successors()) {
+      uint64_t To = getBasicBlockPC(Successor);
+      if (To == 0 || !isJumpTarget(To)) {
+        AllJumpTargets = false;
+        break;
+      }
+
+      uint64_t Count = From != 0 ? Profile.edge(From, To) : Profile.hits(To);
+      Reached |= Count != 0;
+      BranchWeights.push_back(Weight(Count));
+    }
+
+    if (AllJumpTargets && Reached) {
+      T->setMetadata(LLVMContext::MD_prof,
+                     MDB.createBranchWeights(BranchWeights));
+      Annotated++;
+    }
+  }
+
+  DBG("profile", dbg << "Moved " << std::dec << Hot.size()
+                     << " hot jump targets, annotated " << Annotated
+                     << " branches\n");
+}
+
+unsigned JumpTargetManager::createDispatcherTables() {
+  ScopedPhase Phase("createDispatcherTables");
+
+  // Tables are indexed by address, don't use more than this number of entries
+  // for each jump target they contain, the rest is left to the switch
+  const uint64_t MaxEntriesPerTarget = 16;
+
+  const uint64_t Alignment = SourceArchitecture.instructionAlignment();
+  Value *PC = DispatcherSwitch->getCondition();
+  auto *PCType = cast<IntegerType>(PC->getType());
+
+  // Group the cases of the dispatcher by the executable range containing them
+  using TargetsMap = std::map<uint64_t, BasicBlock *>;
+  std::map<uint64_t, TargetsMap> Groups;
+  std::vector<std::pair<ConstantInt *, BasicBlock *>> Remaining;
+  for (auto &Case : DispatcherSwitch->cases()) {
+    ConstantInt *CaseValue = Case.getCaseValue();
+    uint64_t CasePC = CaseValue->getZExtValue();
+    BasicBlock *Target = Case.getCaseSuccessor();
+
+    auto It = findExecutableRange(CasePC);
+    if (It != ExecutableRanges.end() && CasePC % Alignment == 0)
+      Groups[It->first][CasePC] = Target;
+    else
+      Remaining.push_back({ CaseValue, Target });
+  }
+
+  // Each table covers the jump targets of an executable range, from the first
+  // to the last one
+  std::vector<const TargetsMap *> Tables;
+  for (auto &P : Groups) {
+    const TargetsMap &Targets = P.second;
+    uint64_t Base = Targets.begin()->first;
+    uint64_t Entries = (Targets.rbegin()->first - Base) / Alignment + 1;
+
+    if (Entries > MaxEntriesPerTarget * Targets.size()) {
+      for (auto &Target : Targets)
+        Remaining.push_back({ ConstantInt::get(PCType, Target.first),
+                              Target.second });
+      continue;
+    }
+
+    Tables.push_back(&Targets);
+  }
+
+  if (Tables.empty())
+    return 0;
+
+  // Keep the load of the PC in the dispatcher, and move the switch, which will
+  // handle the jump targets not in a table, to a basic block of its own
+  BasicBlock *SwitchBB = Dispatcher->splitBasicBlock(DispatcherSwitch,
+                                                     "dispatcher.switch");
+  Dispatcher->getTerminator()->eraseFromParent();
+
+  Module *TheModule = TheFunction->getParent();
+  Type *Int8PtrTy = Type::getInt8PtrTy(Context);
+  Constant *Fail = BlockAddress::get(TheFunction, DispatcherFail);
+  IRBuilder<> Builder(Context);
+
+  // The basic blocks reached through each table
+  std::map<BasicBlock *, std::vector<BasicBlock *>> NewPredecessors;
+  unsigned Handled = 0;
+
+  BasicBlock *Check = Dispatcher;
+  for (unsigned I = 0; I < Tables.size(); I++) {
+    const TargetsMap &Targets = *Tables[I];
+    uint64_t Base = Targets.begin()->first;
+    uint64_t Entries = (Targets.rbegin()->first - Base) / Alignment + 1;
+
+    BasicBlock *TableBB = BasicBlock::Create(Context,
+                                             "dispatcher.table",
+                                             TheFunction,
+                                             SwitchBB);
+    BasicBlock *Next = SwitchBB;
+    if (I + 1 < Tables.size())
+      Next = BasicBlock::Create(Context,
+                                "dispatcher.check",
+                                TheFunction,
+                                SwitchBB);
+
+    // Use the table only if the PC is within its boundaries and aligned
+    Builder.SetInsertPoint(Check);
+    Value *Offset = Builder.CreateSub(PC, ConstantInt::get(PCType, Base));
+    Value *InRange = Builder.CreateICmpULT(Offset,
+                                           ConstantInt::get(PCType,
+                                                            Entries
+                                                            * Alignment));
+    if (Alignment > 1) {
+      Value *Misalignment = Builder.CreateURem(Offset,
+                                               ConstantInt::get(PCType,
+                                                                Alignment));
+      Value *IsAligned = Builder.CreateICmpEQ(Misalignment,
+                                              ConstantInt::get(PCType, 0));
+      InRange = Builder.CreateAnd(InRange, IsAligned);
+    }
+    Builder.CreateCondBr(InRange, TableBB, Next);
+
+    // Fill the table with the address of the basic block associated to each
+    // jump target, the other entries lead to the dispatcher failure
+    std::vector<Constant *> Values(Entries, Fail);
+    std::set<BasicBlock *> Destinations;
+    for (auto &P : Targets) {
+      Values[(P.first - Base) / Alignment] = BlockAddress::get(TheFunction,
+                                                               P.second);
+      Destinations.insert(P.second);
+    }
+
+    auto *TableType = ArrayType::get(Int8PtrTy, Entries);
+    auto *Table = new GlobalVariable(*TheModule,
+                                     TableType,
+                                     true,
+                                     GlobalValue::InternalLinkage,
+                                     ConstantArray::get(TableType, Values),
+                                     "dispatcher.table");
+
+    Builder.SetInsertPoint(TableBB);
+    Value *Index = Builder.CreateUDiv(Offset,
+                                      ConstantInt::get(PCType, Alignment));
+    Value *Address = Builder.CreateGEP(Table,
+                                       { ConstantInt::get(PCType, 0), Index });
+    Value *Destination = Builder.CreateLoad(Address);
+    IndirectBrInst *Branch = Builder.CreateIndirectBr(Destination,
+                                                      Destinations.size() + 1);
+    Branch->addDestination(DispatcherFail);
+    for (BasicBlock *Target : Destinations) {
+      Branch->addDestination(Target);
+      NewPredecessors[Target].push_back(TableBB);
+    }
+
+    Handled += Targets.size();
+    Check = Next;
+  }
+
+  // Replace the switch with one handling only the remaining jump targets
+  DispatcherSwitch->eraseFromParent();
+  DispatcherSwitch = SwitchInst::Create(PC,
+                                        DispatcherFail,
+                                        Remaining.size(),
+                                        SwitchBB);
+  std::set<BasicBlock *> InSwitch;
+  for (auto &P : Remaining) {
+    DispatcherSwitch->addCase(P.first, P.second);
+    InSwitch.insert(P.second);
+  }
+
+  // Fix the PHI nodes of the basic blocks now reached through a table, using
+  // the value which was coming from the switch
+  for (auto &P : NewPredecessors) {
+    BasicBlock *Target = P.first;
+    for (Instruction &I : *Target) {
+      auto *Phi = dyn_cast<PHINode>(&I);
+      if (Phi == nullptr)
+        break;
+
+      int Index = Phi->getBasicBlockIndex(SwitchBB);
+      if (Index < 0)
+        continue;
+
+      Value *Incoming = Phi->getIncomingValue(Index);
+      if (InSwitch.count(Target) == 0)
+        Phi->removeIncomingValue(Index, false);
+      for (BasicBlock *Predecessor : P.second)
+        Phi->addIncoming(Incoming, Predecessor);
+    }
+  }
+
+  DBG("dispatcher", dbg << std::dec << Handled << " jump targets in "
+                        << Tables.size() << " tables, "
+                        << Remaining.size() << " in the switch\n");
+
+  return Handled;
+}
+
+std::vector<BasicBlock *> JumpTargetManager::dirtyRegion() {
+  std::set<BasicBlock *> Dirty;
+
+  // Everything coming after the watermark has been created since the last
+  // round. If the watermark has been deleted, we have to consider the whole
+  // function.
+  auto It = TheFunction->begin();
+  if (HarvestWatermark != nullptr)
+    It = ++cast<BasicBlock>(static_cast<Value *>(HarvestWatermark))
+      ->getIterator();
+
+  for (BasicBlock &BB : make_range(It, TheFunction->end()))
+    Dirty.insert(&BB);
+
+  for (WeakVH &Split : SplitBlocks)
+    if (Split != nullptr)
+      Dirty.insert(cast<BasicBlock>(static_cast<Value *>(Split)));
+
+  // The head of a jump target registered during the previous round precedes
+  // the watermark, even if it has been lifted since then
+  for (WeakVH &Lifted : LiftedBlocks)
+    if (Lifted != nullptr)
+      Dirty.insert(cast<BasicBlock>(static_cast<Value *>(Lifted)));
+
+  // Extend the region to the immediate neighbours, excluding the dispatcher
+  std::vector<BasicBlock *> Result;
+  std::set<BasicBlock *> Neighbours = Dirty;
+  for (BasicBlock *BB : Dirty) {
+    for (BasicBlock *Successor : successors(BB))
+      Neighbours.insert(Successor);
+    for (BasicBlock *Predecessor : predecessors(BB))
+      Neighbours.insert(Predecessor);
+  }
+
+  for (BasicBlock *BB : Neighbours)
+    if (BB != Dispatcher && BB != DispatcherFail && !BB->empty())
+      Result.push_back(BB);
+
+  return Result;
+}
+
+void JumpTargetManager::resetDirtyRegion() {
+  HarvestWatermark = WeakVH(&*TheFunction->rbegin());
+  freeContainer(SplitBlocks);
+  freeContainer(LiftedBlocks);
+}
+
+/// \brief Is \p Pointer a CPU state variable or a local variable?
+static bool isTrackedVariable(Value *Pointer) {
+  return isa<GlobalVariable>(Pointer) || isa<AllocaInst>(Pointer);
+}
+
+void JumpTargetManager::cleanupDirtyRegion() {
+  const DataLayout &DL = TheModule.getDataLayout();
+  std::vector<BasicBlock *> Region = dirtyRegion();
+
+  DBG("jtcount", dbg << "Cleaning up " << std::dec << Region.size()
+                     << " basic blocks out of " << TheFunction->size()
+                     << ", " << LiftedBlocks.size()
+                     << " jump targets lifted since the previous round\n");
+
+  // Check that the region covers everything lifted since the previous round
+  DBG("verify", {
+      std::set<BasicBlock *> RegionSet(Region.begin(), Region.end());
+      for (WeakVH &Lifted : LiftedBlocks) {
+        auto *BB = cast_or_null<BasicBlock>(static_cast<Value *>(Lifted));
+        if (BB != nullptr && !BB->empty() && RegionSet.count(BB) == 0) {
+          dbgs() << "The dirty region misses " << getName(BB) << "\n";
+          abort();
+        }
+      }
+    });
+
+  for (BasicBlock *BB : Region) {
+    // Last known value of each variable
+    std::map<Value *, Value *> Available;
+    std::vector<Instruction *> Dead;
+
+    for (Instruction &I : *BB) {
+      if (Constant *Folded = ConstantFoldInstruction(&I, DL)) {
+        I.replaceAllUsesWith(Folded);
+        Dead.push_back(&I);
+      } else if (auto *Load = dyn_cast<LoadInst>(&I)) {
+        Value *Pointer = Load->getPointerOperand();
+        if (!Load->isSimple() || !isTrackedVariable(Pointer))
+          continue;
+
+        auto It = Available.find(Pointer);
+        if (It != Available.end() && It->second->getType() == Load->getType()) {
+          Load->replaceAllUsesWith(It->second);
+          Dead.push_back(Load);
+        } else {
+          Available[Pointer] = Load;
+        }
+      } else if (auto *Store = dyn_cast<StoreInst>(&I)) {
+        Value *Pointer = Store->getPointerOperand();
+        if (Store->isSimple() && isTrackedVariable(Pointer))
+          Available[Pointer] = Store->getValueOperand();
+        else
+          Available.clear();
+      } else if (I.mayWriteToMemory()) {
+        // Calls and anything else we don't understand clobber everything
+        Available.clear();
+      }
+    }
+
+    for (Instruction *I : Dead)
+      if (isInstructionTriviallyDead(I))
+        I->eraseFromParent();
+  }
+}
+
 // Harvesting proceeds trying to avoid to run expensive analyses if not strictly
 // necessary, OSRA in particular. To do this we keep in mind two aspects: do we
 // have new basic blocks to visit? If so, we avoid any further anyalysis and
@@ -1152,25 +1842,67 @@ void JumpTargetManager::createDispatcher(Function *OutputFunction,
 // until we either find a new basic block to translate. If we can't find a new
 // block to translate we proceed as long as we are able to create new edges on
 // the CFG (not considering the dispatcher).
+//
+// In incremental mode, ConstantPropagation and EarlyCSE are replaced by
+// cleanupDirtyRegion, which only considers the basic blocks created since the
+// previous round, and SROA is run only if there are new allocas to promote.
 void JumpTargetManager::harvest() {
-  if (empty()) {
-    DBG("verify", if (verifyModule(TheModule, &dbgs())) { abort(); });
+  using Clock = std::chrono::steady_clock;
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
 
-    DBG("jtcount", dbg << "Harvesting: SROA, ConstProp, EarlyCSE and SET\n");
+  // Nothing to do as long as there are jump targets left to translate
+  if (!empty())
+    return;
+
+  auto Start = Clock::now();
+  ScopedPhase Phase("harvest");
+
+  DBG("verify", if (verifyModule(TheModule, &dbgs())) { abort(); });
+
+  if (IncrementalHarvest) {
+    DBG("jtcount", dbg << "Harvesting: incremental cleanup and SET\n");
+
+    // SROA only looks at allocas in the entry block, but it's still worth
+    // to avoid it, since it computes the dominator tree of the whole function
+    BasicBlock &EntryBlock = TheFunction->getEntryBlock();
+    bool HasAllocas = std::any_of(EntryBlock.begin(),
+                                  EntryBlock.end(),
+                                  [] (Instruction &I) {
+                                    return isa<AllocaInst>(&I);
+                                  });
+    if (HasAllocas) {
+      legacy::PassManager SROAPM;
+      SROAPM.add(new PhaseMarkerPass("harvest.SROA"));
+      SROAPM.add(createSROAPass());
+      SROAPM.add(new PhaseMarkerPass(""));
+      SROAPM.run(TheModule);
+    }
+
+    ScopedPhase CleanupPhase("harvest.cleanupDirtyRegion");
+    cleanupDirtyRegion();
+  }
 
-    legacy::PassManager PM;
+  legacy::PassManager PM;
+  if (!IncrementalHarvest) {
+    DBG("jtcount", dbg << "Harvesting: SROA, ConstProp, EarlyCSE and SET\n");
+    PM.add(new PhaseMarkerPass("harvest.SROA"));
     PM.add(createSROAPass()); // temp
+    PM.add(new PhaseMarkerPass("harvest.ConstantPropagation"));
     PM.add(createConstantPropagationPass()); // temp
+    PM.add(new PhaseMarkerPass("harvest.EarlyCSE"));
     PM.add(createEarlyCSEPass());
-    PM.add(new SETPass(this, false, &Visited));
-    PM.add(new TranslateDirectBranchesPass(this));
-    NewBranches = 0;
-    PM.run(TheModule);
-
-    DBG("jtcount", dbg << std::dec
-                       << Unexplored.size() << " new jump targets and "
-                       << NewBranches << " new branches were found\n");
+    PM.add(new PhaseMarkerPass(""));
   }
+  PM.add(new SETPass(this, false, &Visited));
+  PM.add(new TranslateDirectBranchesPass(this));
+  NewBranches = 0;
+  PM.run(TheModule);
+  HarvestRounds++;
+
+  DBG("jtcount", dbg << std::dec
+                     << Unexplored.size() << " new jump targets and "
+                     << NewBranches << " new branches were found\n");
 
   if (EnableOSRA && empty()) {
     DBG("verify", if (verifyModule(TheModule, &dbgs())) { abort(); });
@@ -1188,22 +1920,40 @@ void JumpTargetManager::harvest() {
       Visited.clear();
       legacy::PassManager PM;
       if (NewBranches > 0) {
+        PM.add(new PhaseMarkerPass("harvest.SROA"));
         PM.add(createSROAPass()); // temp
+        PM.add(new PhaseMarkerPass("harvest.ConstantPropagation"));
         PM.add(createConstantPropagationPass()); // temp
+        PM.add(new PhaseMarkerPass("harvest.EarlyCSE"));
         PM.add(createEarlyCSEPass());
+        PM.add(new PhaseMarkerPass(""));
       }
       PM.add(new SETPass(this, true, &Visited));
       PM.add(new TranslateDirectBranchesPass(this));
       NewBranches = 0;
       PM.run(TheModule);
+      HarvestRounds++;
 
       DBG("jtcount", dbg << std::dec
                          << Unexplored.size() << " new jump targets and "
                          << NewBranches << " new branches were found\n");
 
-    } while (empty() && NewBranches > 0);
+    } while (empty() && NewBranches > 0 && !JumpTargetsKnown);
   }
 
+  if (IncrementalHarvest)
+    resetDirtyRegion();
+
+  setCounter("harvest-rounds", HarvestRounds);
+
+  auto Elapsed = Clock::now() - Start;
+  HarvestTime += Elapsed;
+  DBG("jtcount", dbg << "Harvesting took "
+                     << std::dec << duration_cast<milliseconds>(Elapsed).count()
+                     << " ms (overall "
+                     << duration_cast<milliseconds>(HarvestTime).count()
+                     << " ms)\n");
+
   if (empty()) {
     DBG("jtcount", dbg<< "We're done looking for jump targets\n");
   }
@@ -6,6 +6,8 @@
 //
 
 // Standard includes
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <map>
 #include <set>
@@ -14,7 +16,9 @@
 #include <boost/type_traits/is_same.hpp>
 
 // LLVM includes
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/Optional.h"
+#include "llvm/IR/ValueHandle.h"
 
 // Local includes
 #include "datastructures.h"
@@ -34,6 +38,7 @@ class StoreInst;
 class Value;
 }
 
+class ExecutionProfile;
 class JumpTargetManager;
 
 template<typename Map> typename Map::const_iterator
@@ -144,6 +149,8 @@ public:
                            ///  by SET. Likely a function pointer.
     Callee = 128, ///< This JT is the target of a call instruction.
     SumJump = 256, ///< Obtained from the "sumjump" heuristic
+    Profile = 512, ///< Reached at run-time according to the execution profile
+    Hint = 1024, ///< Provided by the user (e.g., from a previous run)
   };
 
   class JumpTarget {
@@ -180,6 +187,10 @@ public:
         SS << " Callee";
       if (hasReason(SumJump))
         SS << " SumJump";
+      if (hasReason(Profile))
+        SS << " Profile";
+      if (hasReason(Hint))
+        SS << " Hint";
 
       return SS.str();
     }
@@ -197,14 +208,22 @@ public:
   /// \param SourceArchitecture the input architecture.
   /// \param Segments a vector of SegmentInfo representing the program.
   /// \param EnableOSRA whether OSRA is enabled or not.
+  /// \param IncrementalHarvest whether the harvesting should only clean up the
+  ///        basic blocks created since the previous round or the whole
+  ///        function.
   JumpTargetManager(llvm::Function *TheFunction,
                     llvm::Value *PCReg,
                     Architecture& SourceArchitecture,
                     std::vector<SegmentInfo>& Segments,
-                    bool EnableOSRA);
+                    bool EnableOSRA,
+                    bool IncrementalHarvest);
 
   /// \brief Collect jump targets from the program's segments
-  void harvestGlobalData();
+  ///
+  /// \param Ranges if not null, consider only the values overlapping these
+  ///        sorted, disjoint address ranges (e.g., the pages changed since a
+  ///        previous translation).
+  void harvestGlobalData(const RangesVector *Ranges = nullptr);
 
   /// Handle a new program counter. We might already have a basic block for that
   /// program counter, or we could even have a translation for it. Return one
@@ -224,7 +243,14 @@ public:
   void registerInstruction(uint64_t PC, llvm::Instruction *Instruction);
 
   /// \brief Translate the non-constant jumps into jumps to the dispatcher
-  void translateIndirectJumps();
+  ///
+  /// The jumps whose destinations have been recovered by the SETPass keep
+  /// the switch over them emitted by TranslateDirectBranchesPass, and use the
+  /// dispatcher only as the default case.
+  ///
+  /// \return the number of indirect jumps whose destinations have been
+  ///         recovered by the SETPass.
+  unsigned translateIndirectJumps();
 
   /// \brief Collect staticists about all the translated basic blocks
   ///
@@ -254,6 +280,21 @@ public:
 
   bool isOSRAEnabled() { return EnableOSRA; }
 
+  /// \brief Mark a call to `exitTB` as a jump whose destinations have been
+  ///        turned into local branches
+  ///
+  /// These are the jumps counted by translateIndirectJumps.
+  void markLocalDispatch(llvm::CallInst *ExitTBCall);
+
+  /// \brief Declare that all the jump targets are known in advance (e.g.,
+  ///        they have been loaded from the analysis cache)
+  ///
+  /// OSRA is then run only once, to handle the indirect jumps, instead of
+  /// looking for new jump targets as long as new branches are found.
+  void setJumpTargetsKnown() { JumpTargetsKnown = true; }
+
+  bool isIncrementalHarvest() const { return IncrementalHarvest; }
+
   /// \brief Pop from the list of program counters to explore
   ///
   /// \return a pair containing the PC and the initial block to use, or
@@ -266,11 +307,8 @@ public:
   /// \brief Return true if the whole [\p Start,\p End) range is in an
   ///        executable segment
   bool isExecutableRange(uint64_t Start, uint64_t End) const {
-    for (std::pair<uint64_t, uint64_t> Range : ExecutableRanges)
-      if (Range.first <= Start && Start < Range.second
-          && Range.first <= End && End < Range.second)
-        return true;
-    return false;
+    auto It = findExecutableRange(Start);
+    return It != ExecutableRanges.end() && It->first <= End && End < It->second;
   }
 
   /// \brief Return true if the given PC respects the input architecture's
@@ -292,10 +330,7 @@ public:
 
   /// \brief Return true if \p PC is in an executable segment
   bool isExecutableAddress(uint64_t PC) const {
-    for (std::pair<uint64_t, uint64_t> Range : ExecutableRanges)
-      if (Range.first <= PC && PC < Range.second)
-        return true;
-    return false;
+    return findExecutableRange(PC) != ExecutableRanges.end();
   }
 
   /// \brief Get the basic block associated to the original address \p PC
@@ -305,6 +340,10 @@ public:
   /// \param PC the PC for which a `BasicBlock` is requested.
   llvm::BasicBlock *getBlockAt(uint64_t PC);
 
+  /// \brief Associate the jump target at \p PC to \p BB, e.g., after its code
+  ///        has been moved out of the root function
+  void replaceBlockAt(uint64_t PC, llvm::BasicBlock *BB);
+
   /// \brief Return, and, if necessary, register the basic block associated to
   ///        \p PC
   ///
@@ -318,12 +357,17 @@ public:
   ///         valid or another error occurred.
   llvm::BasicBlock *registerJT(uint64_t PC, JTReason Reason);
 
-  std::map<uint64_t, JumpTarget>::const_iterator begin() const {
-    return JumpTargets.begin();
+  using JumpTargetsVector = std::vector<std::pair<uint64_t, JumpTarget>>;
+
+  /// \brief Iterate over the jump targets, sorted by address
+  JumpTargetsVector::const_iterator begin() const {
+    updateSortedJumpTargets();
+    return SortedJumpTargets.begin();
   }
 
-  std::map<uint64_t, JumpTarget>::const_iterator end() const {
-    return JumpTargets.end();
+  JumpTargetsVector::const_iterator end() const {
+    updateSortedJumpTargets();
+    return SortedJumpTargets.end();
   }
 
   void registerJT(llvm::BasicBlock *BB, JTReason Reason) {
@@ -338,6 +382,25 @@ public:
   /// \brief Removes a `BasicBlock` from the SET's visited list
   void unvisit(llvm::BasicBlock *BB);
 
+  /// \brief Use the execution profile to optimize the translated code
+  ///
+  /// Sort the cases of the dispatcher by hotness, move the hottest jump
+  /// targets close to each other at the beginning of the function and annotate
+  /// with branch weights the dispatcher and the branches among jump targets.
+  void applyProfile(const ExecutionProfile &Profile);
+
+  /// \brief Move the cases of the dispatcher to lookup tables
+  ///
+  /// For each executable range, create a table indexed by (PC - base) /
+  /// alignment containing the address of the basic block associated to each
+  /// jump target, and jump there through an indirectbr. Jump targets outside
+  /// any executable range, or in ranges too sparse for a table, are left to
+  /// the switch. Since the analyses expect a switch, this has to be done at
+  /// the end of the translation.
+  ///
+  /// \return the number of jump targets handled through a table.
+  unsigned createDispatcherTables();
+
   /// \brief Return a pointer to the dispatcher basic block.
   llvm::BasicBlock *dispatcher() const { return Dispatcher; }
 
@@ -486,6 +549,14 @@ public:
 
   const interval_set &readRange() const { return ReadIntervalSet; }
 
+  /// \brief Return the boundaries of the input basic blocks translated so far
+  RangesVector originalBBs() const {
+    RangesVector Result;
+    for (auto &P : OriginalBBStats)
+      Result.push_back({ P.first, P.first + P.second.Size });
+    return Result;
+  }
+
   NoReturnAnalysis &noReturn() { return NoReturn; }
 
 private:
@@ -503,25 +574,96 @@ private:
     return It;
   }
 
-  // TODO: instead of a gigantic switch case we could map the original memory
-  //       area and write the address of the translated basic block at the jump
-  //       target
   void createDispatcher(llvm::Function *OutputFunction,
                         llvm::Value *SwitchOnPtr,
                         bool JumpDirectly);
 
+  /// \brief Cheap, conservative check for values that might be code pointers
+  struct CodePointerFilter {
+    uint64_t Low;
+    uint64_t Span;
+    uint64_t AlignmentMask;
+  };
+
+  /// \brief A candidate code pointer: its offset in the segment and its value
+  using CodePointer = std::pair<uint64_t, uint64_t>;
+
+  /// \brief Collect the candidate code pointers starting in [\p Start, \p End)
+  ///
+  /// This function does not touch the state of the JumpTargetManager, and can
+  /// therefore be run concurrently on different portions of the data.
+  ///
+  /// \param Offset offset of \p Start within its segment.
   template<typename value_type, unsigned endian>
-  void findCodePointers(uint64_t StartVirtualAddress,
-                        const unsigned char *Start,
-                        const unsigned char *End);
+  static void findCodePointers(const CodePointerFilter &Filter,
+                               const unsigned char *Start,
+                               const unsigned char *End,
+                               uint64_t Offset,
+                               std::vector<CodePointer> &Candidates);
 
   void harvest();
 
+  /// \brief Return the basic blocks created, split or lifted since the last
+  ///        harvest, along with their immediate neighbours
+  std::vector<llvm::BasicBlock *> dirtyRegion();
+
+  /// \brief Lightweight replacement of ConstantPropagation and EarlyCSE
+  ///        operating only on the dirty region
+  ///
+  /// Folds constant expressions and performs store-to-load forwarding and
+  /// redundant load elimination on CPU state variables within each basic
+  /// block.
+  void cleanupDirtyRegion();
+
+  /// \brief Mark as clean everything has been created so far
+  void resetDirtyRegion();
+
   void handleSumJump(llvm::Instruction *SumJump);
 
+  /// \brief Build the table of readable segments used by readRawValue
+  void createSegmentsTable();
+
+  /// \brief Rebuild the sorted copy of JumpTargets, if it's out of date
+  void updateSortedJumpTargets() const {
+    if (!SortedJumpTargetsDirty)
+      return;
+
+    SortedJumpTargets.assign(JumpTargets.begin(), JumpTargets.end());
+    std::sort(SortedJumpTargets.begin(), SortedJumpTargets.end(),
+              [] (const std::pair<uint64_t, JumpTarget> &A,
+                  const std::pair<uint64_t, JumpTarget> &B) {
+                return A.first < B.first;
+              });
+    SortedJumpTargetsDirty = false;
+  }
+
+  /// \brief Find the executable range containing \p PC
+  ///
+  /// \return an iterator to the range containing \p PC, or
+  ///         `ExecutableRanges.end()` if \p PC is not executable.
+  RangesVector::const_iterator findExecutableRange(uint64_t PC) const {
+    // Find the first range starting after PC, the previous one is the only
+    // candidate to contain it
+    using Range = std::pair<uint64_t, uint64_t>;
+    auto It = std::upper_bound(ExecutableRanges.begin(),
+                               ExecutableRanges.end(),
+                               PC,
+                               [] (uint64_t PC, const Range &R) {
+                                 return PC < R.first;
+                               });
+    if (It == ExecutableRanges.begin())
+      return ExecutableRanges.end();
+
+    --It;
+    if (PC < It->second)
+      return It;
+
+    return ExecutableRanges.end();
+  }
+
 private:
-  using BlockMap = std::map<uint64_t, JumpTarget>;
-  using InstructionMap = std::map<uint64_t, llvm::Instruction *>;
+  using BlockMap = llvm::DenseMap<uint64_t, JumpTarget>;
+  using InstructionMap = llvm::DenseMap<uint64_t, llvm::Instruction *>;
 
   llvm::Module &TheModule;
   llvm::LLVMContext& Context;
@@ -531,10 +673,16 @@ private:
   InstructionMap OriginalInstructionAddresses;
   /// Holds the association between a PC and a BasicBlock.
   BlockMap JumpTargets;
-  /// Queue of program counters we still have to translate.
-  std::vector<BlockWithAddress> Unexplored;
+  /// Copy of JumpTargets sorted by address, used for iteration
+  mutable JumpTargetsVector SortedJumpTargets;
+  mutable bool SortedJumpTargetsDirty = true;
+  /// Stack of program counters we still have to translate, indexed by PC.
+  IndexedStack<uint64_t, llvm::BasicBlock *> Unexplored;
   llvm::Value *PCReg;
   llvm::Function *ExitTB;
+  /// Kind of the metadata marking the calls to `exitTB` handled by pinJTs
+  unsigned LocalDispatchMDKind;
+  /// Sorted and coalesced list of the executable [start, end) ranges
   RangesVector ExecutableRanges;
   llvm::BasicBlock *Dispatcher;
   llvm::SwitchInst *DispatcherSwitch;
@@ -544,10 +692,40 @@ private:
   std::vector<SegmentInfo>& Segments;
   Architecture &SourceArchitecture;
 
+  /// \brief Raw data of a readable segment
+  struct ReadableSegment {
+    uint64_t StartVirtualAddress;
+    uint64_t EndVirtualAddress;
+    /// Data from the input file, the rest of the segment is zero-filled
+    llvm::ArrayRef<uint8_t> Data;
+  };
+
+  /// Readable segments sorted by start address
+  std::vector<ReadableSegment> ReadableSegments;
+
+  /// Functions reading 1, 2, 4 and 8 bytes in the input endianess
+  using ReadFunction = uint64_t (*)(const unsigned char *);
+  ReadFunction Readers[4];
+
   bool EnableOSRA;
 
+  bool IncrementalHarvest;
+  bool JumpTargetsKnown = false;
+  /// Last basic block of the function at the end of the previous harvest,
+  /// everything coming after it is new
+  llvm::WeakVH HarvestWatermark;
+  /// Basic blocks obtained splitting existing basic blocks since the previous
+  /// harvest
+  std::vector<llvm::WeakVH> SplitBlocks;
+  /// Jump targets lifted since the previous harvest
+  std::vector<llvm::WeakVH> LiftedBlocks;
+  /// Overall time spent in harvest()
+  std::chrono::steady_clock::duration HarvestTime;
+
   std::map<uint64_t, BBSummary> OriginalBBStats;
   unsigned NewBranches = 0;
+  /// Number of runs of SET (with or without OSRA) performed by harvest()
+  unsigned HarvestRounds = 0;
 
   std::set<uint64_t> UnusedCodePointers;
   interval_set ReadIntervalSet;
@@ -33,6 +33,7 @@ extern "C" {
 #include "argparse.h"
 #include "ptcinterface.h"
 #include "codegenerator.h"
+#include "timereport.h"
 
 PTCInterface ptc = {}; ///< The interface with the PTC library.
 static std::string LibTinycodePath;
@@ -49,8 +50,24 @@ struct ProgramParameters {
   const char *CoveragePath;
   const char *BBSummaryPath;
   bool NoOSRA;
+  bool IncrementalHarvest;
   bool EnableTracing;
   bool UseSections;
+  bool EmitBitcode;
+  bool IsolateFunctions;
+  int SplitModules;
+  DispatcherType Dispatcher;
+  int InlineCaches;
+  bool InlineCacheCounters;
+  const char *ProfilePath;
+  int ShadowStack;
+  const char *CacheDirectory;
+  const char *JumpTargetsPath;
+  const char *ExportJumpTargetsPath;
+  const char *PreviousStatePath;
+  const char *SaveStatePath;
+  bool TimeReport;
+  const char *TimeReportJSONPath;
 };
 
 using LibraryDestructor = GenericFunctor<decltype(&dlclose), &dlclose>;
@@ -146,6 +163,8 @@ static int parseArgs(int Argc, const char *Argv[],
   const char *DebugString = nullptr;
   const char *DebugLoggingString = nullptr;
   const char *EntryPointAddressString = nullptr;
+  const char *EmitString = nullptr;
+  const char *DispatcherString = nullptr;
   long long EntryPointAddress = 0;
 
   // Initialize argument parser
@@ -175,15 +194,87 @@ static int parseArgs(int Argc, const char *Argv[],
                " assembly of the input file, 'ptc' for debug information"
                " referred to the Portable Tiny Code, or 'll' for debug"
                " information referred to the LLVM IR."),
+    OPT_STRING('E', "emit",
+               &EmitString,
+               "output format. Possible values are 'll' (the default) for"
+               " textual LLVM IR or 'bc' for LLVM bitcode."),
     OPT_STRING('d', "debug",
                &DebugLoggingString,
                "enable verbose logging."),
     OPT_BOOLEAN('O', "no-osra", &Parameters->NoOSRA,
                 "disable OSRA"),
+    OPT_BOOLEAN('I', "incremental-harvest", &Parameters->IncrementalHarvest,
+                "only clean up the newly translated code while harvesting"
+                " jump targets."),
     OPT_BOOLEAN('t', "tracing", &Parameters->EnableTracing,
                 "enable PC tracing in the output binary (through newPC)"),
     OPT_BOOLEAN('S', "use-sections", &Parameters->UseSections,
                 "use section informations, if available."),
+    OPT_BOOLEAN('f', "isolate-functions", &Parameters->IsolateFunctions,
+                "emit an LLVM function for each detected function, instead of"
+                " keeping all the code in the root function."),
+    OPT_INTEGER('p', "split-modules", &Parameters->SplitModules,
+                "split the output into the given number of modules, which can"
+                " be compiled in parallel. The first one is written to OUTFILE,"
+                " the others to OUTFILE.partN. Mostly useful together with"
+                " --isolate-functions."),
+    OPT_STRING('D', "dispatcher",
+               &DispatcherString,
+               "type of dispatcher. Possible values are 'switch' (the"
+               " default) for a switch over all the jump targets or 'table'"
+               " for lookup tables indexed by the PC."),
+    OPT_INTEGER('C', "inline-caches", &Parameters->InlineCaches,
+                "compare the PC against up to the given number of predicted"
+                " destinations before jumping to the dispatcher on function"
+                " returns. The default is 0 (disabled)."),
+    OPT_BOOLEAN('K', "inline-cache-counters",
+                &Parameters->InlineCacheCounters,
+                "count hits and misses of each inline cache. The counters"
+                " are saved in the file specified by the"
+                " REVAMB_INLINE_CACHE_STATS environment variable."),
+    OPT_STRING('P', "profile",
+               &Parameters->ProfilePath,
+               "execution profile to guide the translation, as produced by a"
+               " program translated with --tracing and run with the"
+               " REVAMB_PROFILE environment variable set."),
+    OPT_INTEGER('R', "shadow-stack", &Parameters->ShadowStack,
+                "push the return address on a shadow stack of the given"
+                " number of entries on function calls, and jump directly to"
+                " it on function returns, if it matches. Must be a power of"
+                " two. The default is 0 (disabled)."),
+    OPT_STRING('A', "cache-dir",
+               &Parameters->CacheDirectory,
+               "directory where to cache the jump targets found by the"
+               " analyses, so that translating again the same binary with the"
+               " same analysis options skips most of them."),
+    OPT_STRING('J', "jump-targets",
+               &Parameters->JumpTargetsPath,
+               "jump targets to register before starting the translation, in"
+               " the format produced by --export-jump-targets. The reasons"
+               " associated to each jump target are preserved: to mark a"
+               " function entry point use the Callee reason (128)."),
+    OPT_STRING('X', "export-jump-targets",
+               &Parameters->ExportJumpTargetsPath,
+               "destination path for the list of the jump targets found,"
+               " along with the reasons they have been found for."),
+    OPT_STRING('V', "previous-state",
+               &Parameters->PreviousStatePath,
+               "state saved by --save-state translating a previous version of"
+               " the input binary (e.g., before patching it). Only the jump"
+               " targets depending on the changed pages are discovered again,"
+               " the rest are reused. The analysis options should be the same"
+               " as the ones of the previous translation."),
+    OPT_STRING('W', "save-state",
+               &Parameters->SaveStatePath,
+               "destination path for the state of the translation, to be"
+               " used with --previous-state to translate a patched version of"
+               " the input binary."),
+    OPT_BOOLEAN('T', "time-report", &Parameters->TimeReport,
+                "print the time and memory spent in each phase."),
+    OPT_STRING('j', "time-report-json",
+               &Parameters->TimeReportJSONPath,
+               "destination path for the JSON report of the time and memory"
+               " spent in each phase."),
     OPT_STRING('b', "bb-summary",
                &Parameters->BBSummaryPath,
                "destination path for the CSV containing the statistics about "
@@ -237,6 +328,51 @@ static int parseArgs(int Argc, const char *Argv[],
     }
   }
 
+  if (EmitString != nullptr) {
+    if (strcmp("ll", EmitString) == 0) {
+      Parameters->EmitBitcode = false;
+    } else if (strcmp("bc", EmitString) == 0) {
+      Parameters->EmitBitcode = true;
+    } else {
+      fprintf(stderr, "Unexpected value for the output format parameter"
+              " (-E, --emit).\n");
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (DispatcherString != nullptr) {
+    if (strcmp("switch", DispatcherString) == 0) {
+      Parameters->Dispatcher = DispatcherType::Switch;
+    } else if (strcmp("table", DispatcherString) == 0) {
+      Parameters->Dispatcher = DispatcherType::Table;
+    } else {
+      fprintf(stderr, "Unexpected value for the dispatcher type parameter"
+              " (-D, --dispatcher).\n");
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Debug information referring to the LLVM IR need a separate textual copy
+  if (Parameters->EmitBitcode
+      && Parameters->DebugInfo == DebugInfoType::LLVMIR
+      && Parameters->DebugPath == nullptr) {
+    fprintf(stderr, "Emitting bitcode with LLVM IR debug information requires"
+            " a separate debug path (-s, --debug-path).\n");
+    return EXIT_FAILURE;
+  }
+
+  // The output is rewritten after the split, therefore the debug information
+  // referring to the LLVM IR would point to lines of a module which is never
+  // written, unless it goes to a separate file
+  if (Parameters->SplitModules > 1
+      && Parameters->DebugInfo == DebugInfoType::LLVMIR
+      && Parameters->DebugPath == nullptr) {
+    fprintf(stderr, "Splitting the output (-p, --split-modules) with LLVM IR"
+            " debug information requires a separate debug path (-s,"
+            " --debug-path).\n");
+    return EXIT_FAILURE;
+  }
+
   if (DebugLoggingString != nullptr) {
     DebuggingEnabled = true;
     std::string Input(DebugLoggingString);
@@ -258,6 +394,52 @@ static int parseArgs(int Argc, const char *Argv[],
   if (Parameters->BBSummaryPath == nullptr)
     Parameters->BBSummaryPath = "";
 
+  if (Parameters->ProfilePath == nullptr)
+    Parameters->ProfilePath = "";
+
+  if (Parameters->CacheDirectory == nullptr)
+    Parameters->CacheDirectory = "";
+
+  if (Parameters->JumpTargetsPath == nullptr)
+    Parameters->JumpTargetsPath = "";
+
+  if (Parameters->ExportJumpTargetsPath == nullptr)
+    Parameters->ExportJumpTargetsPath = "";
+
+  if (Parameters->PreviousStatePath == nullptr)
+    Parameters->PreviousStatePath = "";
+
+  if (Parameters->SaveStatePath == nullptr)
+    Parameters->SaveStatePath = "";
+
+  if (Parameters->SplitModules < 0) {
+    fprintf(stderr, "The number of modules (-p, --split-modules) can't be"
+            " negative.\n");
+    return EXIT_FAILURE;
+  }
+
+  if (Parameters->InlineCaches < 0) {
+    fprintf(stderr, "The number of destinations of the inline caches (-C,"
+            " --inline-caches) can't be negative.\n");
+    return EXIT_FAILURE;
+  }
+
+  if (Parameters->InlineCacheCounters && Parameters->InlineCaches == 0) {
+    fprintf(stderr, "Inline cache counters (-K, --inline-cache-counters)"
+            " require inline caches (-C, --inline-caches).\n");
+    return EXIT_FAILURE;
+  }
+
+  if (Parameters->ShadowStack < 0
+      || (Parameters->ShadowStack & (Parameters->ShadowStack - 1)) != 0) {
+    fprintf(stderr, "The size of the shadow stack (-R, --shadow-stack) must"
+            " be a power of two.\n");
+    return EXIT_FAILURE;
+  }
+
+  if (Parameters->TimeReport || Parameters->TimeReportJSONPath != nullptr)
+    TimeReportEnabled = true;
+
   return EXIT_SUCCESS;
 }
 
@@ -274,24 +456,55 @@ int main(int argc, const char *argv[]) {
   if (loadPTCLibrary(PTCLibrary) != EXIT_SUCCESS)
     return EXIT_FAILURE;
 
+  ResourceUsage TotalStart = ResourceUsage::now();
+
   // Translate everything
   Architecture TargetArchitecture;
+  CodeGenerator::Options Options;
+  Options.DebugInfo = Parameters.DebugInfo;
+  Options.DebugPath = Parameters.DebugPath;
+  Options.LinkingInfoPath = Parameters.LinkingInfoPath;
+  Options.CoveragePath = Parameters.CoveragePath;
+  Options.BBSummaryPath = Parameters.BBSummaryPath;
+  Options.EnableOSRA = !Parameters.NoOSRA;
+  Options.IncrementalHarvest = Parameters.IncrementalHarvest;
+  Options.EnableTracing = Parameters.EnableTracing;
+  Options.UseSections = Parameters.UseSections;
+  Options.EmitBitcode = Parameters.EmitBitcode;
+  Options.IsolateFunctions = Parameters.IsolateFunctions;
+  Options.SplitModules = Parameters.SplitModules;
+  Options.Dispatcher = Parameters.Dispatcher;
+  Options.InlineCaches = Parameters.InlineCaches;
+  Options.InlineCacheCounters = Parameters.InlineCacheCounters;
+  Options.ProfilePath = Parameters.ProfilePath;
+  Options.ShadowStack = Parameters.ShadowStack;
+  Options.CacheDirectory = Parameters.CacheDirectory;
+  Options.JumpTargetsHintsPath = Parameters.JumpTargetsPath;
+  Options.ExportJumpTargetsPath = Parameters.ExportJumpTargetsPath;
+  Options.PreviousStatePath = Parameters.PreviousStatePath;
+  Options.SaveStatePath = Parameters.SaveStatePath;
+
   CodeGenerator Generator(std::string(Parameters.InputPath),
                           TargetArchitecture,
                           std::string(Parameters.OutputPath),
                           LibHelpersPath,
-                          Parameters.DebugInfo,
-                          std::string(Parameters.DebugPath),
-                          std::string(Parameters.LinkingInfoPath),
-                          std::string(Parameters.CoveragePath),
-                          std::string(Parameters.BBSummaryPath),
-                          !Parameters.NoOSRA,
-                          Parameters.EnableTracing,
-                          Parameters.UseSections);
+                          Options);
 
   Generator.translate(Parameters.EntryPointAddress, "root");
 
   Generator.serialize();
 
+  if (TimeReportEnabled) {
+    recordPhase("total", TotalStart);
+
+    if (Parameters.TimeReport)
+      printTimeReport(dbg);
+
+    if (Parameters.TimeReportJSONPath != nullptr) {
+      std::ofstream Output(Parameters.TimeReportJSONPath);
+      printTimeReportJSON(Output);
+    }
+  }
+
   return EXIT_SUCCESS;
 }
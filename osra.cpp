@@ -26,6 +26,7 @@
 #include "revamb.h"
 #include "ir-helpers.h"
 #include "osra.h"
+#include "timereport.h"
 
 using namespace llvm;
 
@@ -925,6 +926,7 @@ BoundedValue OSRAPass::pathSensitiveMerge(LoadInst *Reached) {
 // * bounded variable (or BV): a free value and the range within which it lies.
 bool OSRAPass::runOnFunction(Function &F) {
   DBG("passes", { dbg << "Starting OSRAPass\n"; });
+  ScopedPhase Phase("harvest.OSRA");
 
   const DataLayout DL = F.getParent()->getDataLayout();
   RDP = &getAnalysis<ConditionalReachedLoadsPass>();
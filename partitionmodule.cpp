@@ -0,0 +1,136 @@
+/// \file partitionmodule.cpp
+/// \brief Split the output module in parts which can be compiled in parallel.
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <algorithm>
+
+// LLVM includes
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+// Local includes
+#include "debug.h"
+#include "partitionmodule.h"
+#include "timereport.h"
+
+using namespace llvm;
+
+void ModulePartitioner::externalize() {
+  auto Externalize = [] (GlobalValue &GV) {
+    if (GV.isDeclaration())
+      return;
+
+    if (GV.hasLocalLinkage() || GV.hasLinkOnceLinkage()) {
+      GV.setLinkage(GlobalValue::ExternalLinkage);
+      GV.setVisibility(GlobalValue::HiddenVisibility);
+      if (auto *GO = dyn_cast<GlobalObject>(&GV))
+        GO->setComdat(nullptr);
+    }
+
+    // We need a name to reference a symbol from another partition
+    if (!GV.hasName())
+      GV.setName("revamb.unnamed");
+  };
+
+  for (Function &F : *TheModule)
+    Externalize(F);
+
+  for (GlobalVariable &GV : TheModule->globals())
+    Externalize(GV);
+
+  for (GlobalAlias &GA : TheModule->aliases())
+    Externalize(GA);
+}
+
+void ModulePartitioner::assign() {
+  // Assign the largest functions first, each one to the partition with the
+  // least instructions so far
+  std::vector<std::pair<size_t, const Function *>> Sizes;
+  for (Function &F : *TheModule) {
+    if (F.isDeclaration())
+      continue;
+
+    size_t Size = 0;
+    for (BasicBlock &BB : F)
+      Size += BB.size();
+
+    Sizes.push_back({ Size, &F });
+  }
+
+  // Keep the module order among functions of the same size, so that the
+  // result is reproducible
+  std::stable_sort(Sizes.begin(),
+                   Sizes.end(),
+                   [] (const std::pair<size_t, const Function *> &A,
+                       const std::pair<size_t, const Function *> &B) {
+                     return A.first > B.first;
+                   });
+
+  std::vector<size_t> Loads(Count, 0);
+  for (auto &P : Sizes) {
+    auto Lightest = std::min_element(Loads.begin(), Loads.end());
+    unsigned Index = Lightest - Loads.begin();
+    *Lightest += P.first;
+    if (Index != 0)
+      Partitions[P.second] = Index;
+  }
+
+  DBG("partition", {
+      for (unsigned I = 0; I < Count; I++)
+        dbg << "Partition " << std::dec << I << ": "
+            << Loads[I] << " instructions\n";
+    });
+}
+
+unsigned ModulePartitioner::partitionOf(const GlobalValue *GV) const {
+  auto *F = dyn_cast<Function>(GV);
+  if (F == nullptr)
+    return 0;
+
+  auto It = Partitions.find(F);
+  return It == Partitions.end() ? 0 : It->second;
+}
+
+std::vector<std::unique_ptr<Module>> ModulePartitioner::run() {
+  ScopedPhase Phase("PartitionModule");
+
+  std::vector<std::unique_ptr<Module>> Result;
+  if (Count <= 1)
+    return Result;
+
+  externalize();
+  assign();
+
+  for (unsigned I = 1; I < Count; I++) {
+    ValueToValueMapTy VMap;
+    auto ShouldClone = [this, I] (const GlobalValue *GV) {
+      return partitionOf(GV) == I;
+    };
+    std::unique_ptr<Module> Part = CloneModule(TheModule, VMap, ShouldClone);
+
+    // Intrinsic global variables (e.g., llvm.used) are handled by the first
+    // partition, and they can't be declarations
+    std::vector<GlobalVariable *> ToErase;
+    for (GlobalVariable &GV : Part->globals())
+      if (GV.isDeclaration() && GV.getName().startswith("llvm."))
+        ToErase.push_back(&GV);
+    for (GlobalVariable *GV : ToErase)
+      GV->eraseFromParent();
+
+    Result.push_back(std::move(Part));
+  }
+
+  // Only keep the declarations of the functions handled by other partitions
+  for (Function &F : *TheModule)
+    if (partitionOf(&F) != 0)
+      F.deleteBody();
+
+  return Result;
+}
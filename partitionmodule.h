@@ -0,0 +1,66 @@
+#ifndef _PARTITIONMODULE_H
+#define _PARTITIONMODULE_H
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace llvm {
+class Function;
+class GlobalValue;
+class Module;
+}
+
+/// \brief Split a module into a set of modules which can be compiled
+///        independently and then linked together
+///
+/// Each function defined in the module is assigned to a partition, balancing
+/// the number of instructions in each of them. All the global variables (the
+/// CPU state, the segments and so on) are defined only in the first partition,
+/// which is the original module, and declared in all the others. All the
+/// symbols with local linkage are made external with hidden visibility, so
+/// that they can be referenced from other partitions.
+///
+/// Splitting the module is useful only if the code is not all in the root
+/// function, i.e., if the functions have been isolated.
+class ModulePartitioner {
+public:
+  /// \param TheModule the module to split, it will become the first
+  ///        partition.
+  /// \param Count the number of partitions to create.
+  ModulePartitioner(llvm::Module *TheModule, unsigned Count) :
+    TheModule(TheModule),
+    Count(Count) { }
+
+  /// \brief Perform the split
+  ///
+  /// \return the partitions other than the first one, which is the original
+  ///         module, stripped of the definitions of the functions assigned to
+  ///         the other partitions.
+  std::vector<std::unique_ptr<llvm::Module>> run();
+
+private:
+  /// \brief Make all the symbols visible from the other partitions
+  void externalize();
+
+  /// \brief Assign each function to a partition
+  void assign();
+
+  /// \brief Return the partition which has to define \p GV
+  unsigned partitionOf(const llvm::GlobalValue *GV) const;
+
+private:
+  llvm::Module *TheModule;
+  unsigned Count;
+
+  /// Partition in charge of each function, functions not in the map belong to
+  /// the first one
+  std::map<const llvm::Function *, unsigned> Partitions;
+};
+
+#endif // _PARTITIONMODULE_H
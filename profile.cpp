@@ -0,0 +1,52 @@
+/// \file profile.cpp
+/// \brief Load the execution profile produced by the support runtime.
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <cstring>
+#include <fstream>
+
+// Local includes
+#include "debug.h"
+#include "profile.h"
+
+static const char Magic[] = "RVMBPRF1";
+
+bool ExecutionProfile::read(std::string Path) {
+  std::ifstream Input(Path, std::ios::binary);
+  if (!Input)
+    return false;
+
+  char Header[8];
+  uint64_t Capacity = 0;
+  uint64_t Dropped = 0;
+  Input.read(Header, sizeof(Header));
+  Input.read(reinterpret_cast<char *>(&Capacity), sizeof(Capacity));
+  Input.read(reinterpret_cast<char *>(&Dropped), sizeof(Dropped));
+  if (!Input || memcmp(Header, Magic, sizeof(Header)) != 0)
+    return false;
+
+  uint64_t Entry[3];
+  for (uint64_t I = 0; I < Capacity; I++) {
+    if (!Input.read(reinterpret_cast<char *>(Entry), sizeof(Entry)))
+      return false;
+
+    uint64_t From = Entry[0];
+    uint64_t To = Entry[1];
+    uint64_t Count = Entry[2];
+    if (To == 0 || Count == 0)
+      continue;
+
+    Edges[{ From, To }] += Count;
+    Hits[To] += Count;
+  }
+
+  DBG("profile", dbg << "Loaded " << std::dec << Edges.size() << " edges and "
+                     << Hits.size() << " PCs from " << Path << ", "
+                     << Dropped << " edges have been dropped\n");
+
+  return true;
+}
@@ -0,0 +1,58 @@
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+
+/// \brief Execution profile of a translated program
+///
+/// The profile is produced by the support runtime of a program translated
+/// with tracing enabled and run with the `REVAMB_PROFILE` environment variable
+/// set. It counts how many times the execution went from a jump target to
+/// another.
+///
+/// The file starts with a header (the "RVMBPRF1" magic, the number of entries
+/// and the number of edges which didn't fit), followed by the entries. Each
+/// entry is composed by three 64-bit words in host byte order: the source PC,
+/// the destination PC and the number of times the edge has been taken. The
+/// same edge might appear more than once.
+class ExecutionProfile {
+public:
+  using Edge = std::pair<uint64_t, uint64_t>;
+
+public:
+  /// \brief Load the profile at \p Path
+  ///
+  /// \return true if the profile has been loaded successfully.
+  bool read(std::string Path);
+
+  bool empty() const { return Hits.empty(); }
+
+  /// \brief Number of times each PC has been reached, sorted by PC
+  const std::map<uint64_t, uint64_t> &hits() const { return Hits; }
+
+  /// \brief Number of times \p PC has been reached
+  uint64_t hits(uint64_t PC) const {
+    auto It = Hits.find(PC);
+    return It == Hits.end() ? 0 : It->second;
+  }
+
+  /// \brief Number of times the execution went from \p From to \p To
+  uint64_t edge(uint64_t From, uint64_t To) const {
+    auto It = Edges.find({ From, To });
+    return It == Edges.end() ? 0 : It->second;
+  }
+
+private:
+  std::map<Edge, uint64_t> Edges;
+  std::map<uint64_t, uint64_t> Hits;
+};
+
+#endif // _PROFILE_H
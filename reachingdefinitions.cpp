@@ -26,6 +26,7 @@
 #include "debug.h"
 #include "ir-helpers.h"
 #include "reachingdefinitions.h"
+#include "timereport.h"
 
 // #include "valgrind/callgrind.h"
 
@@ -677,6 +678,10 @@ bool ReachingDefinitionsImplPass<BBI, R>::runOnFunction(Function &F) {
         dbg << "Starting ReachingDefinitionsPass\n";
     });
 
+  ScopedPhase Phase(std::is_same<BBI, ConditionalBasicBlockInfo>::value ?
+                    "harvest.ConditionalReachingDefinitions" :
+                    "harvest.ReachingDefinitions");
+
   for (auto &BB : F) {
     if (!BB.empty()) {
       if (auto *Call = dyn_cast<CallInst>(&*BB.begin())) {
@@ -28,6 +28,13 @@ enum class DebugInfoType {
   LLVMIR ///< produce an LLVM IR with debug metadata referring to itself.
 };
 
+/// \brief Type of dispatcher to emit in the output
+enum class DispatcherType {
+  Switch, ///< a switch with a case for each jump target.
+  Table ///< a lookup table for each executable range, followed by an
+        ///  indirectbr.
+};
+
 /// \brief Simple data structure to describe an ELF segment
 // TODO: information hiding
 struct SegmentInfo {
@@ -36,6 +43,9 @@ struct SegmentInfo {
 
   llvm::GlobalVariable *Variable; ///< \brief LLVM variable containing this
                                   ///  segment's data
+  /// \brief Data of the segment available in the input file, still in the
+  ///        mapping of the input. The rest of the segment is zero-filled.
+  llvm::ArrayRef<uint8_t> Data;
   uint64_t StartVirtualAddress;
   uint64_t EndVirtualAddress;
   bool IsWriteable;
@@ -24,6 +24,7 @@
 #include "osra.h"
 #include "jumptargetmanager.h"
 #include "set.h"
+#include "timereport.h"
 
 using namespace llvm;
 using std::make_pair;
@@ -466,6 +467,7 @@ void SETPass::getAnalysisUsage(AnalysisUsage &AU) const {
 
 bool SETPass::runOnFunction(Function &F) {
   DBG("passes", { dbg << "Starting SETPass\n"; });
+  ScopedPhase Phase("harvest.SET");
 
   freeContainer(Jumps);
 
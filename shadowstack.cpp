@@ -0,0 +1,187 @@
+/// \file shadowstack.cpp
+/// \brief Use a shadow stack to jump directly to the return addresses.
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <map>
+#include <set>
+#include <vector>
+
+// LLVM includes
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+// Local includes
+#include "debug.h"
+#include "ir-helpers.h"
+#include "jumptargetmanager.h"
+#include "shadowstack.h"
+#include "timereport.h"
+
+using namespace llvm;
+
+void ShadowStackBuilder::collect(const FunctionCallsMap &FunctionCalls,
+                                 const ReturnsSet &Returns) {
+  for (auto &P : FunctionCalls) {
+    Call NewCall;
+    NewCall.Jump = P.first;
+    NewCall.ReturnBlock = P.second;
+    Calls.push_back(NewCall);
+  }
+
+  for (TerminatorInst *Return : Returns)
+    this->Returns.push_back(Return);
+}
+
+unsigned ShadowStackBuilder::run() {
+  ScopedPhase Phase("ShadowStack");
+
+  Module *TheModule = Root->getParent();
+  LLVMContext &Context = TheModule->getContext();
+  Value *PCReg = JTM->pcReg();
+  auto *PCType = cast<IntegerType>(PCReg->getType()->getPointerElementType());
+  Type *AddressType = Type::getInt8PtrTy(Context);
+  Type *IndexType = Type::getInt32Ty(Context);
+
+  // Consider only the calls and the returns still in the root function, the
+  // isolation of functions might have moved them elsewhere
+  std::map<TerminatorInst *, BasicBlock *> CallsMap;
+  for (Call &C : Calls) {
+    auto *Jump = cast_or_null<TerminatorInst>(C.Jump);
+    auto *ReturnBlock = cast_or_null<BasicBlock>(C.ReturnBlock);
+    if (Jump != nullptr
+        && ReturnBlock != nullptr
+        && Jump->getParent()->getParent() == Root
+        && ReturnBlock->getParent() == Root)
+      CallsMap[Jump] = ReturnBlock;
+  }
+
+  std::set<TerminatorInst *> ReturnsSet;
+  for (WeakVH &Return : Returns)
+    if (auto *Jump = cast_or_null<TerminatorInst>(Return))
+      ReturnsSet.insert(Jump);
+
+  // Visit the root function in order, to obtain a deterministic output
+  std::vector<std::pair<TerminatorInst *, BasicBlock *>> RootCalls;
+  std::vector<TerminatorInst *> RootReturns;
+  std::vector<BasicBlock *> ReturnBlocks;
+  std::set<BasicBlock *> ReturnBlocksSet;
+  for (BasicBlock &BB : *Root) {
+    TerminatorInst *T = BB.getTerminator();
+    auto It = CallsMap.find(T);
+    if (It != CallsMap.end()) {
+      RootCalls.push_back(*It);
+      if (ReturnBlocksSet.insert(It->second).second)
+        ReturnBlocks.push_back(It->second);
+    } else if (ReturnsSet.count(T) != 0) {
+      RootReturns.push_back(T);
+    }
+  }
+
+  if (RootCalls.empty() || RootReturns.empty())
+    return 0;
+
+  // Initialize the return addresses with an invalid PC, so that the empty
+  // entries never match
+  auto *PCsType = ArrayType::get(PCType, Size);
+  std::vector<Constant *> InvalidPCs(Size, Constant::getAllOnesValue(PCType));
+  auto *PCs = new GlobalVariable(*TheModule,
+                                 PCsType,
+                                 false,
+                                 GlobalValue::InternalLinkage,
+                                 ConstantArray::get(PCsType, InvalidPCs),
+                                 "shadow_stack_pcs");
+  auto *AddressesType = ArrayType::get(AddressType, Size);
+  Constant *NoAddresses = ConstantAggregateZero::get(AddressesType);
+  auto *Addresses = new GlobalVariable(*TheModule,
+                                       AddressesType,
+                                       false,
+                                       GlobalValue::InternalLinkage,
+                                       NoAddresses,
+                                       "shadow_stack_addresses");
+  auto *Top = new GlobalVariable(*TheModule,
+                                 IndexType,
+                                 false,
+                                 GlobalValue::InternalLinkage,
+                                 ConstantInt::get(IndexType, 0),
+                                 "shadow_stack_top");
+  Constant *Mask = ConstantInt::get(IndexType, Size - 1);
+
+  IRBuilder<> Builder(Context);
+  auto Slot = [&] (GlobalVariable *Stack, Value *Index) {
+    Value *Indices[] = { Builder.getInt32(0), Index };
+    return Builder.CreateGEP(Stack, Indices);
+  };
+
+  // Push the return address and its basic block before each call
+  for (auto &P : RootCalls) {
+    Builder.SetInsertPoint(P.first);
+    Value *OldTop = Builder.CreateLoad(Top);
+    Value *NewTop = Builder.CreateAnd(Builder.CreateAdd(OldTop,
+                                                        Builder.getInt32(1)),
+                                      Mask);
+    Builder.CreateStore(NewTop, Top);
+    Builder.CreateStore(ConstantInt::get(PCType, getBasicBlockPC(P.second)),
+                        Slot(PCs, NewTop));
+    Builder.CreateStore(BlockAddress::get(Root, P.second),
+                        Slot(Addresses, NewTop));
+  }
+
+  // All the hits go through a single indirect branch, whose destinations are
+  // all the basic blocks which can be pushed on the shadow stack
+  BasicBlock *Dispatcher = JTM->dispatcher();
+  BasicBlock *Return = BasicBlock::Create(Context, "shadowstack.return", Root);
+  Builder.SetInsertPoint(Return);
+  PHINode *Address = Builder.CreatePHI(AddressType, RootReturns.size());
+  IndirectBrInst *Branch = Builder.CreateIndirectBr(Address,
+                                                    ReturnBlocks.size());
+  for (BasicBlock *ReturnBlock : ReturnBlocks) {
+    Branch->addDestination(ReturnBlock);
+
+    // The new predecessor provides the same values as the dispatcher
+    for (Instruction &I : *ReturnBlock) {
+      auto *Phi = dyn_cast<PHINode>(&I);
+      if (Phi == nullptr)
+        break;
+
+      Value *Incoming = UndefValue::get(Phi->getType());
+      int DispatcherIndex = Phi->getBasicBlockIndex(Dispatcher);
+      if (DispatcherIndex >= 0)
+        Incoming = Phi->getIncomingValue(DispatcherIndex);
+      Phi->addIncoming(Incoming, Return);
+    }
+  }
+
+  // Pop the top of the shadow stack before each return, in case of a miss
+  // proceed with the original terminator
+  for (TerminatorInst *T : RootReturns) {
+    BasicBlock *BB = T->getParent();
+    BasicBlock *Miss = BB->splitBasicBlock(T, "shadowstack.miss");
+    BB->getTerminator()->eraseFromParent();
+
+    Builder.SetInsertPoint(BB);
+    Value *OldTop = Builder.CreateLoad(Top);
+    Value *PredictedPC = Builder.CreateLoad(Slot(PCs, OldTop));
+    Value *PredictedAddress = Builder.CreateLoad(Slot(Addresses, OldTop));
+    Value *NewTop = Builder.CreateAnd(Builder.CreateSub(OldTop,
+                                                        Builder.getInt32(1)),
+                                      Mask);
+    Builder.CreateStore(NewTop, Top);
+    Value *Hit = Builder.CreateICmpEQ(PredictedPC, Builder.CreateLoad(PCReg));
+    Builder.CreateCondBr(Hit, Return, Miss);
+    Address->addIncoming(PredictedAddress, BB);
+  }
+
+  DBG("shadowstack", dbg << "Instrumented " << std::dec << RootCalls.size()
+                         << " calls and " << RootReturns.size()
+                         << " returns, " << ReturnBlocks.size()
+                         << " possible return addresses\n");
+
+  return RootReturns.size();
+}
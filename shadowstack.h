@@ -0,0 +1,80 @@
+#ifndef _SHADOWSTACK_H
+#define _SHADOWSTACK_H
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <map>
+#include <set>
+#include <vector>
+
+// LLVM includes
+#include "llvm/IR/ValueHandle.h"
+
+namespace llvm {
+class BasicBlock;
+class Function;
+class TerminatorInst;
+}
+
+class JumpTargetManager;
+
+/// \brief Turn function returns into direct branches using a shadow stack
+///
+/// Before each function call, the return address and the address of the
+/// basic block handling it are pushed on a shadow stack. Each return
+/// instruction pops the top of the shadow stack and, if the popped return
+/// address matches the PC, jumps directly to the associated basic block,
+/// otherwise it proceeds as usual (e.g., going through the dispatcher).
+///
+/// The shadow stack is a fixed-size circular buffer, therefore deep
+/// recursions and non-local control flow (e.g., `longjmp`) only cause misses.
+/// The shadow stack is shared among all the threads, as the CPU state is.
+class ShadowStackBuilder {
+public:
+  using FunctionCallsMap = std::map<llvm::TerminatorInst *, llvm::BasicBlock *>;
+  using ReturnsSet = std::set<llvm::TerminatorInst *>;
+
+  /// \param Root the function containing all the translated code.
+  /// \param JTM the JumpTargetManager associated to \p Root.
+  /// \param Size number of entries of the shadow stack, must be a power of
+  ///        two.
+  ShadowStackBuilder(llvm::Function *Root,
+                     JumpTargetManager *JTM,
+                     unsigned Size) :
+    Root(Root),
+    JTM(JTM),
+    Size(Size) { }
+
+  /// \brief Collect the function calls and the return instructions
+  ///
+  /// This has to be done while the results of the
+  /// FunctionBoundariesDetectionPass are still valid, i.e., before the
+  /// functions are isolated.
+  void collect(const FunctionCallsMap &FunctionCalls,
+               const ReturnsSet &Returns);
+
+  /// \brief Emit the pushes and the pops for each collected call and return
+  ///        still in the root function
+  ///
+  /// \return the number of return instructions using the shadow stack.
+  unsigned run();
+
+private:
+  struct Call {
+    llvm::WeakVH Jump; ///< the terminator performing the call
+    llvm::WeakVH ReturnBlock; ///< the basic block the callee returns to
+  };
+
+private:
+  llvm::Function *Root;
+  JumpTargetManager *JTM;
+  unsigned Size;
+
+  std::vector<Call> Calls;
+  std::vector<llvm::WeakVH> Returns;
+};
+
+#endif // _SHADOWSTACK_H
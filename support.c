@@ -4,10 +4,12 @@
 
 #include <elf.h>
 #include <endian.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <string.h>
 #include <unistd.h>
@@ -221,6 +223,209 @@ void unknownPC() {
   abort();
 }
 
+// Execution profile: count how many times the execution goes from a jump
+// target to another. The counters are in an open addressing hash table mapped
+// from the file specified by REVAMB_PROFILE, so that they are preserved even
+// if the program terminates through the exit_group syscall. See profile.h for
+// the file format.
+#define PROFILE_DEFAULT_SIZE (1 << 20)
+// Maximum number of slots looked up for an edge before dropping it, so that a
+// nearly full table doesn't turn each lookup in a full scan
+#define PROFILE_MAX_PROBES 64
+
+struct profile_header {
+  char magic[8];
+  uint64_t size;
+  uint64_t dropped;
+};
+
+struct profile_entry {
+  uint64_t from;
+  uint64_t to;
+  uint64_t count;
+};
+
+static struct profile_header *profile_header;
+static struct profile_entry *profile_entries;
+static __thread uint64_t profile_last_pc;
+
+static void profile_init(void) {
+  const char *path = getenv("REVAMB_PROFILE");
+  const char *size_string = getenv("REVAMB_PROFILE_SIZE");
+  uint64_t entries = PROFILE_DEFAULT_SIZE;
+  size_t size;
+  void *mapping;
+  int fd;
+
+  if (path == NULL)
+    return;
+
+  if (size_string != NULL && strtoull(size_string, NULL, 0) != 0)
+    entries = strtoull(size_string, NULL, 0);
+  size = sizeof(struct profile_header) + entries * sizeof(struct profile_entry);
+
+  fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || ftruncate(fd, size) != 0)
+    abort();
+
+  mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    abort();
+
+  profile_header = mapping;
+  profile_entries = (struct profile_entry *) (profile_header + 1);
+  memcpy(profile_header->magic, "RVMBPRF1", sizeof(profile_header->magic));
+  profile_header->size = entries;
+}
+
+static void profile_edge(uint64_t from, uint64_t to) {
+  uint64_t size = profile_header->size;
+  uint64_t index = ((from * 0x9e3779b97f4a7c15ULL) ^ to) % size;
+  uint64_t probe;
+
+  // Claim a slot atomically through its destination. Another thread might see
+  // the slot before the source has been written and use another one for the
+  // same edge, which is fine, since the entries are summed up.
+  for (probe = 0; probe < size && probe < PROFILE_MAX_PROBES; probe++) {
+    struct profile_entry *entry = &profile_entries[(index + probe) % size];
+    uint64_t expected = 0;
+
+    if (entry->to == to && entry->from == from) {
+      __atomic_fetch_add(&entry->count, 1, __ATOMIC_RELAXED);
+      return;
+    }
+
+    if (entry->to == 0
+        && __atomic_compare_exchange_n(&entry->to, &expected, to, 0,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      entry->from = from;
+      __atomic_fetch_add(&entry->count, 1, __ATOMIC_RELAXED);
+      return;
+    }
+  }
+
+  __atomic_fetch_add(&profile_header->dropped, 1, __ATOMIC_RELAXED);
+}
+
+// Binary trace: the PC of each executed jump target is appended to a
+// per-thread buffer, which is a window on the file specified by REVAMB_TRACE.
+// When the buffer is full, the window is moved forward in the file, and the
+// kernel writes out the previous one in bulk. This also preserves the trace if
+// the program terminates through the exit_group syscall. The main thread uses
+// REVAMB_TRACE, the other ones append their thread ID to it.
+//
+// The file starts with a page containing the header (the "RVMBTRC1" magic,
+// the number of PCs and the sampling rate), followed by the PCs, as 64-bit
+// words in host byte order. Use trace-to-text to obtain the same output
+// produced without REVAMB_TRACE.
+#define TRACE_HEADER_SIZE 4096
+#define TRACE_DEFAULT_BUFFER_SIZE (1 << 20)
+
+struct trace_header {
+  char magic[8];
+  uint64_t count;
+  uint64_t sampling;
+};
+
+static const char *trace_path;
+static uint64_t trace_buffer_size = TRACE_DEFAULT_BUFFER_SIZE;
+static uint64_t trace_sampling = 1;
+static __thread int trace_fd = -1;
+static __thread struct trace_header *trace_header;
+static __thread uint64_t *trace_buffer;
+static __thread uint64_t trace_buffer_used;
+static __thread uint64_t trace_buffer_offset;
+static __thread uint64_t trace_skipped;
+
+static void trace_init(void) {
+  const char *buffer_size_string = getenv("REVAMB_TRACE_BUFFER");
+  const char *sampling_string = getenv("REVAMB_TRACE_SAMPLING");
+  const uint64_t page_entries = TRACE_HEADER_SIZE / sizeof(uint64_t);
+
+  trace_path = getenv("REVAMB_TRACE");
+  if (trace_path == NULL)
+    return;
+
+  // The buffer must be a multiple of the page size, to be mapped
+  if (buffer_size_string != NULL
+      && strtoull(buffer_size_string, NULL, 0) != 0) {
+    trace_buffer_size = strtoull(buffer_size_string, NULL, 0);
+    trace_buffer_size += page_entries - 1;
+    trace_buffer_size -= trace_buffer_size % page_entries;
+  }
+
+  if (sampling_string != NULL && strtoull(sampling_string, NULL, 0) != 0)
+    trace_sampling = strtoull(sampling_string, NULL, 0);
+}
+
+static void trace_map_buffer(void) {
+  const size_t size = trace_buffer_size * sizeof(uint64_t);
+
+  if (trace_buffer != NULL)
+    munmap(trace_buffer, size);
+
+  if (ftruncate(trace_fd, trace_buffer_offset + size) != 0)
+    abort();
+
+  trace_buffer = mmap(NULL,
+                      size,
+                      PROT_READ | PROT_WRITE,
+                      MAP_SHARED,
+                      trace_fd,
+                      trace_buffer_offset);
+  if (trace_buffer == MAP_FAILED)
+    abort();
+
+  trace_buffer_used = 0;
+}
+
+static void trace_open(void) {
+  char path[4096];
+  pid_t tid = syscall(SYS_gettid);
+
+  if (tid == getpid())
+    snprintf(path, sizeof(path), "%s", trace_path);
+  else
+    snprintf(path, sizeof(path), "%s.%d", trace_path, (int) tid);
+
+  trace_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (trace_fd < 0 || ftruncate(trace_fd, TRACE_HEADER_SIZE) != 0)
+    abort();
+
+  trace_header = mmap(NULL,
+                      TRACE_HEADER_SIZE,
+                      PROT_READ | PROT_WRITE,
+                      MAP_SHARED,
+                      trace_fd,
+                      0);
+  if (trace_header == MAP_FAILED)
+    abort();
+
+  memcpy(trace_header->magic, "RVMBTRC1", sizeof(trace_header->magic));
+  trace_header->sampling = trace_sampling;
+
+  trace_buffer_offset = TRACE_HEADER_SIZE;
+  trace_map_buffer();
+}
+
+static void trace_pc(uint64_t pc) {
+  // Record only one PC every trace_sampling
+  if (trace_sampling > 1 && trace_skipped++ % trace_sampling != 0)
+    return;
+
+  if (trace_fd < 0)
+    trace_open();
+
+  if (trace_buffer_used == trace_buffer_size) {
+    trace_buffer_offset += trace_buffer_size * sizeof(uint64_t);
+    trace_map_buffer();
+  }
+
+  trace_buffer[trace_buffer_used++] = pc;
+  trace_header->count++;
+}
+
 void newpc(uint64_t pc,
            uint64_t instruction_size,
            uint32_t is_first,
@@ -232,6 +437,20 @@ void newpc(uint64_t pc,
   if (!is_first)
     return;
 
+  // If we're collecting a profile or a binary trace, don't print the PC
+  if (profile_header != NULL || trace_path != NULL) {
+    if (profile_header != NULL) {
+      if (pc != 0)
+        profile_edge(profile_last_pc, pc);
+      profile_last_pc = pc;
+    }
+
+    if (trace_path != NULL)
+      trace_pc(pc);
+
+    return;
+  }
+
   *last_pos = '\n';
   last_pos--;
 
@@ -252,6 +471,47 @@ void newpc(uint64_t pc,
   }
 }
 
+// Inline caches statistics: the translated code provides the PC of each
+// inline cache, and increments the hits and misses counters following it. The
+// counters are in a file mapping, if requested, so that they are preserved
+// even if the program terminates through the exit_group syscall.
+extern const uint64_t inline_cache_sites[] __attribute__((weak));
+extern const uint32_t inline_cache_sites_count __attribute__((weak));
+uint64_t *inline_cache_counters;
+
+static void inline_cache_init(void) {
+  const char *path = getenv("REVAMB_INLINE_CACHE_STATS");
+  size_t size;
+  uint32_t i;
+  int fd = -1;
+  int flags = MAP_ANONYMOUS | MAP_PRIVATE;
+
+  if (&inline_cache_sites_count == NULL || inline_cache_sites_count == 0)
+    return;
+
+  size = inline_cache_sites_count * 3 * sizeof(uint64_t);
+
+  if (path != NULL) {
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0 && ftruncate(fd, size) == 0)
+      flags = MAP_SHARED;
+  }
+
+  inline_cache_counters = mmap(NULL,
+                               size,
+                               PROT_READ | PROT_WRITE,
+                               flags,
+                               flags == MAP_SHARED ? fd : -1,
+                               0);
+  if (fd >= 0)
+    close(fd);
+  if (inline_cache_counters == MAP_FAILED)
+    abort();
+
+  for (i = 0; i < inline_cache_sites_count; i++)
+    inline_cache_counters[i * 3] = inline_cache_sites[i];
+}
+
 int main(int argc, char *argv[]) {
   saved_argc = argc;
   saved_argv = argv;
@@ -274,6 +534,12 @@ int main(int argc, char *argv[]) {
 
   syscall_init();
 
+  inline_cache_init();
+
+  profile_init();
+
+  trace_init();
+
   root();
 
   return 0;
@@ -4,19 +4,27 @@
 
 # Sadly, to use a cross-compiler we need an external CMake project
 include(ExternalProject)
+include(CMakeParseArguments)
 
 # Test definitions
 
 set(TEST_CFLAGS "-std=c99 -static -fno-pic -fno-pie -g")
-set(TESTS "calc" "function_call" "floating_point" "syscall" "global")
+set(TESTS "calc" "function_call" "floating_point" "syscall" "global"
+  "function_pointers")
 
 ## calc
 set(TEST_SOURCES_calc "${CMAKE_SOURCE_DIR}/tests/calc.c")
 
-set(TEST_RUNS_calc "literal" "sum" "multiplication")
+set(TEST_RUNS_calc "literal" "sum" "multiplication" "failure")
 set(TEST_ARGS_calc_literal "12")
 set(TEST_ARGS_calc_sum "'(+ 4 5)'")
 set(TEST_ARGS_calc_multiplication "'(* 5 6)'")
+set(TEST_ARGS_calc_failure "'(% 4 5)'")
+
+# Patched version of calc, to test the translation reusing the state of the
+# translation of calc
+set(PATCHED_TESTS "calc")
+set(TEST_SOURCES_calc_patched "${CMAKE_SOURCE_DIR}/tests/calc-patched.c")
 
 ## function_call
 set(TEST_SOURCES_function_call "${CMAKE_SOURCE_DIR}/tests/function-call.c")
@@ -42,6 +50,67 @@ set(TEST_SOURCES_global "${CMAKE_SOURCE_DIR}/tests/global.c")
 set(TEST_RUNS_global "default")
 set(TEST_ARGS_global_default "nope")
 
+## function_pointers
+# Checks the jump targets found only in global data are translated correctly,
+# the many_jump_targets benchmark measures the time spent handling them
+set(TEST_SOURCES_function_pointers "${CMAKE_SOURCE_DIR}/tests/function-pointers.c")
+
+set(TEST_RUNS_function_pointers "default")
+set(TEST_ARGS_function_pointers_default "nope")
+
+# Benchmark definitions
+#
+# Synthetic programs stressing the translation, they are not tested for
+# correctness but only used by the benchmark-translation targets
+
+set(BENCHMARK_SCALE "1"
+  CACHE
+  STRING
+  "Multiplier for the size of the generated benchmark programs.")
+set(BENCHMARK_BASELINE_DIRECTORY "${CMAKE_BINARY_DIR}/benchmarks/baseline"
+  CACHE
+  PATH
+  "Directory containing the translation benchmarks baselines.")
+set(BENCHMARK_THRESHOLD "10"
+  CACHE
+  STRING
+  "Maximum tolerated regression of the translation benchmarks, in percent.")
+
+set(BENCHMARK_SRC "${CMAKE_BINARY_DIR}/benchmarks/sources")
+execute_process(COMMAND "${CMAKE_SOURCE_DIR}/tests/generate-benchmarks"
+  "${BENCHMARK_SRC}" "${BENCHMARK_SCALE}")
+
+set(BENCHMARKS "big_switch" "many_functions" "large_data" "many_jump_targets")
+set(TEST_SOURCES_big_switch "${BENCHMARK_SRC}/big-switch.c")
+set(TEST_SOURCES_many_functions "${BENCHMARK_SRC}/many-functions.c")
+set(TEST_SOURCES_large_data "${BENCHMARK_SRC}/large-data.c")
+set(TEST_SOURCES_many_jump_targets "${BENCHMARK_SRC}/many-jump-targets.c")
+
+# CPU-bound programs used by the benchmark-runtime targets to compare the
+# translated code against qemu-user and the native build, with each type of
+# dispatcher and each size of the shadow stack
+set(BENCHMARK_RUNTIME_RUNS "5"
+  CACHE
+  STRING
+  "Number of runs of each configuration in the run-time benchmarks.")
+set(BENCHMARK_DISPATCHERS "switch;table"
+  CACHE
+  STRING
+  "Types of dispatcher to compare in the run-time benchmarks.")
+set(BENCHMARK_SHADOW_STACKS "0;64"
+  CACHE
+  STRING
+  "Sizes of the shadow stack to compare in the run-time benchmarks, 0 to"
+  " disable it.")
+
+set(RUNTIME_BENCHMARKS "cpu_bound" "indirect_branches" "call_heavy")
+set(TEST_SOURCES_cpu_bound "${CMAKE_SOURCE_DIR}/tests/cpu-bound.c")
+set(BENCHMARK_ARGS_cpu_bound "200")
+set(TEST_SOURCES_indirect_branches "${CMAKE_SOURCE_DIR}/tests/indirect-branches.c")
+set(BENCHMARK_ARGS_indirect_branches "5000")
+set(TEST_SOURCES_call_heavy "${CMAKE_SOURCE_DIR}/tests/call-heavy.c")
+set(BENCHMARK_ARGS_call_heavy "500")
+
 # Get the path to some system tools we'll need
 
 set(LLC "${LLVM_TOOLS_BINARY_DIR}/llc")
@@ -62,6 +131,10 @@ foreach(ARCH ${SUPPORTED_ARCHITECTURES})
     CACHE
     STRING
     "Path to the C compiler to use to build tests for ${ARCH}.")
+  set(BENCHMARK_BINARIES_${ARCH} ""
+    CACHE
+    STRING
+    "Additional ${ARCH} binaries to use in the translation benchmarks.")
 
   find_library(LIBTINYCODE_${ARCH} "libtinycode-${ARCH}.so"
     HINTS "${QEMU_LIB_PATH}" "${CMAKE_INSTALL_PREFIX}/lib")
@@ -117,6 +190,14 @@ foreach(TEST_NAME ${TESTS})
   endforeach()
 endforeach()
 
+# Create native executables for the run-time benchmarks
+foreach(BENCHMARK_NAME ${RUNTIME_BENCHMARKS})
+  add_executable(benchmark-native-${BENCHMARK_NAME} EXCLUDE_FROM_ALL
+    ${TEST_SOURCES_${BENCHMARK_NAME}})
+  set_target_properties(benchmark-native-${BENCHMARK_NAME} PROPERTIES COMPILE_FLAGS "${TEST_CFLAGS}")
+  set_target_properties(benchmark-native-${BENCHMARK_NAME} PROPERTIES LINK_FLAGS "${TEST_CFLAGS}")
+endforeach()
+
 # Helper macro to "evaluate" CMake variables such as CMAKE_C_LINK_EXECUTABLE,
 # which looks like this:
 # <CMAKE_C_COMPILER> <FLAGS> <CMAKE_C_LINK_FLAGS> <LINK_FLAGS> <OBJECTS>
@@ -139,6 +220,100 @@ function(compile_executable OBJECTS TARGET OUTPUT)
   parse("${CMAKE_C_LINK_EXECUTABLE}" "${OUTPUT}")
 endfunction()
 
+# Add the tests translating ${TEST_NAME} for ${ARCH} with the additional
+# options REVAMB_FLAGS, compiling the result and checking its output
+# corresponds to the qemu-user's one for each set of arguments. The names of
+# the tests and of the produced files are derived from SUFFIX. Optional
+# arguments:
+# * EXTENSION: extension of the translated file, "ll" by default.
+# * MODULES: number of modules the translated file is split into.
+# * BEFORE/AFTER: shell commands to run before/after the translation.
+# * DEPENDS: tests the translation depends on.
+# * CHECK_BEFORE/CHECK_AFTER: shell commands to run before/after running the
+#   translated program, @RUN_NAME@ is replaced with the name of the run.
+# * NO_CHECK: don't compare the output with the qemu-user's one.
+function(add_translation_variant SUFFIX REVAMB_FLAGS)
+  cmake_parse_arguments(VARIANT "NO_CHECK"
+    "EXTENSION;MODULES;BEFORE;AFTER;CHECK_BEFORE;CHECK_AFTER"
+    "DEPENDS"
+    ${ARGN})
+  if(NOT VARIANT_EXTENSION)
+    set(VARIANT_EXTENSION "ll")
+  endif()
+  if(NOT VARIANT_MODULES)
+    set(VARIANT_MODULES 1)
+  endif()
+
+  set(NAME "${TEST_NAME}-${ARCH}")
+  set(BASE "${BIN}/${TEST_NAME}.${SUFFIX}")
+  set(OUTPUT "${BASE}.${VARIANT_EXTENSION}")
+
+  # Test to translate the compiled binary
+  set(TRANSLATE "$<TARGET_FILE:revamb> --use-sections -g none ${REVAMB_FLAGS} --architecture ${ARCH} ${BIN}/${TEST_NAME} ${OUTPUT}")
+  if(VARIANT_BEFORE)
+    set(TRANSLATE "${VARIANT_BEFORE} && ${TRANSLATE}")
+  endif()
+  if(VARIANT_AFTER)
+    set(TRANSLATE "${TRANSLATE} && ${VARIANT_AFTER}")
+  endif()
+  add_test(NAME translate-${SUFFIX}-${NAME} COMMAND sh -c "${TRANSLATE}")
+  set_tests_properties(translate-${SUFFIX}-${NAME}
+    PROPERTIES LABELS "translate-${SUFFIX};${TEST_NAME};${ARCH}")
+  if(VARIANT_DEPENDS)
+    set_tests_properties(translate-${SUFFIX}-${NAME}
+      PROPERTIES DEPENDS "${VARIANT_DEPENDS}")
+  endif()
+
+  # Compile each of the translated modules and link them together with
+  # support.c
+  set(COMPILE "${LLC} -O0 -filetype=obj ${OUTPUT} -o ${BASE}${CMAKE_C_OUTPUT_EXTENSION}")
+  set(OBJECTS "${BASE}${CMAKE_C_OUTPUT_EXTENSION}")
+  set(PART 1)
+  while(PART LESS VARIANT_MODULES)
+    set(COMPILE "${COMPILE} && ${LLC} -O0 -filetype=obj ${OUTPUT}.part${PART} -o ${BASE}.part${PART}${CMAKE_C_OUTPUT_EXTENSION}")
+    set(OBJECTS "${OBJECTS} ${BASE}.part${PART}${CMAKE_C_OUTPUT_EXTENSION}")
+    math(EXPR PART "${PART} + 1")
+  endwhile()
+
+  compile_executable("$(${CMAKE_BINARY_DIR}/li-csv-to-ld-options ${OUTPUT}.li.csv) ${OBJECTS} ${CMAKE_BINARY_DIR}/support.c -DTARGET_${NORMALIZED_ARCH} -lz -lm -lrt -Wno-pointer-to-int-cast -Wno-int-to-pointer-cast -g -fno-pie"
+    "${BASE}.translated"
+    COMPILE_TRANSLATED)
+
+  add_test(NAME compile-translated-${SUFFIX}-${NAME}
+    COMMAND sh -c "${COMPILE} && ${COMPILE_TRANSLATED}")
+  set_tests_properties(compile-translated-${SUFFIX}-${NAME}
+    PROPERTIES DEPENDS translate-${SUFFIX}-${NAME}
+               LABELS "compile-translated-${SUFFIX};${TEST_NAME};${ARCH}")
+
+  if(VARIANT_NO_CHECK)
+    return()
+  endif()
+
+  # Check the output of the translated binary corresponds to the qemu-user's
+  # one
+  foreach(RUN_NAME ${TEST_RUNS_${TEST_NAME}})
+    set(RUN_ARGS "${TEST_ARGS_${TEST_NAME}_${RUN_NAME}}")
+    set(CHECK "${BASE}.translated ${RUN_ARGS} | ${DIFF} - ${BIN}/run-qemu-test-${TEST_NAME}-${RUN_NAME}.log")
+    if(VARIANT_CHECK_BEFORE)
+      string(CONFIGURE "${VARIANT_CHECK_BEFORE}" CHECK_BEFORE @ONLY)
+      set(CHECK "${CHECK_BEFORE} && ${CHECK}")
+    endif()
+    if(VARIANT_CHECK_AFTER)
+      string(CONFIGURE "${VARIANT_CHECK_AFTER}" CHECK_AFTER @ONLY)
+      set(CHECK "${CHECK} && ${CHECK_AFTER}")
+    endif()
+
+    set(CHECK_NAME check-${SUFFIX}-with-qemu-${TEST_NAME}-${RUN_NAME}-${ARCH})
+    add_test(NAME ${CHECK_NAME} COMMAND sh -c "${CHECK}")
+    set(DEPS "")
+    list(APPEND DEPS "compile-translated-${SUFFIX}-${NAME}")
+    list(APPEND DEPS "run-qemu-test-${TEST_NAME}-${RUN_NAME}-${ARCH}")
+    set_tests_properties(${CHECK_NAME}
+      PROPERTIES DEPENDS "${DEPS}"
+                 LABELS "check-${SUFFIX}-with-qemu;${TEST_NAME};${RUN_NAME};${ARCH}")
+  endforeach()
+endfunction()
+
 enable_testing()
 foreach(ARCH ${SUPPORTED_ARCHITECTURES})
   set(TEST_SRC ${CMAKE_CURRENT_SOURCE_DIR}/tests)
@@ -148,9 +323,13 @@ foreach(ARCH ${SUPPORTED_ARCHITECTURES})
 
   # Prepare CMake parameters for subproject
   # Sadly, we can't put a list into TEST_SOURCES_ARGS, since it is a list too
-  string(REPLACE ";" ":" TEST_NAMES "${TESTS}")
+  set(PROGRAMS ${TESTS} ${BENCHMARKS} ${RUNTIME_BENCHMARKS})
+  foreach(TEST_NAME ${PATCHED_TESTS})
+    list(APPEND PROGRAMS "${TEST_NAME}_patched")
+  endforeach()
+  string(REPLACE ";" ":" TEST_NAMES "${PROGRAMS}")
   set(TEST_SOURCES_ARGS "-DTESTS=${TEST_NAMES}")
-  foreach(TEST_NAME ${TESTS})
+  foreach(TEST_NAME ${PROGRAMS})
     set(SOURCES "${TEST_SOURCES_${TEST_NAME}}")
     string(REPLACE ";" ":" SOURCES "${SOURCES}")
     list(APPEND TEST_SOURCES_ARGS -DTEST_SOURCES_${TEST_NAME}=${SOURCES})
@@ -196,6 +375,75 @@ foreach(ARCH ${SUPPORTED_ARCHITECTURES})
       PROPERTIES DEPENDS translate-${TEST_NAME}-${ARCH}
                  LABELS "compile-translated;${TEST_NAME};${ARCH}")
 
+    # Test to translate the compiled binary with the incremental harvesting,
+    # checking that each cleanup covers all the jump targets lifted since the
+    # previous round
+    set(HARVEST_LOG "${BIN}/${TEST_NAME}.incremental-harvest.log")
+    add_test(NAME translate-incremental-harvest-${TEST_NAME}-${ARCH}
+      COMMAND sh -c "$<TARGET_FILE:revamb> --use-sections -g none --incremental-harvest -d verify,jtcount --architecture ${ARCH} ${BIN}/${TEST_NAME} ${BIN}/${TEST_NAME}.incremental-harvest.ll > ${HARVEST_LOG} 2>&1 && grep -q 'jump targets lifted since the previous round' ${HARVEST_LOG}")
+    set_tests_properties(translate-incremental-harvest-${TEST_NAME}-${ARCH}
+      PROPERTIES LABELS "translate-incremental-harvest;${TEST_NAME};${ARCH}")
+
+    # Emitting bitcode
+    add_translation_variant(bitcode "--emit bc" EXTENSION bc)
+
+    # Isolating functions
+    add_translation_variant(isolated "--isolate-functions")
+
+    # Splitting the output in two modules
+    add_translation_variant(split "--isolate-functions --split-modules 2"
+      MODULES 2)
+
+    # With inline caches and their counters, checking that the statistics
+    # about the inline caches can be printed, if the program has any
+    set(IC_STATS "${BIN}/${TEST_NAME}-@RUN_NAME@.ic.stats")
+    add_translation_variant(ic "--inline-caches 4 --inline-cache-counters"
+      CHECK_BEFORE "rm -f ${IC_STATS} && export REVAMB_INLINE_CACHE_STATS=${IC_STATS}"
+      CHECK_AFTER "(test ! -e ${IC_STATS} || ${CMAKE_BINARY_DIR}/inline-cache-stats ${IC_STATS})")
+
+    # With a shadow stack for the returns
+    add_translation_variant(ss "--shadow-stack 64")
+
+    # Twice with the analysis cache, the second time using the results of the
+    # first one
+    set(CACHE_DIR "${BIN}/${TEST_NAME}.cache")
+    add_translation_variant(cached
+      "--cache-dir ${CACHE_DIR} --time-report-json ${BIN}/${TEST_NAME}.cached.json"
+      BEFORE "rm -rf ${CACHE_DIR} && $<TARGET_FILE:revamb> --use-sections -g none --cache-dir ${CACHE_DIR} --architecture ${ARCH} ${BIN}/${TEST_NAME} ${BIN}/${TEST_NAME}.cached.ll"
+      AFTER "grep -q '\"cached-jump-targets\": [1-9]' ${BIN}/${TEST_NAME}.cached.json")
+
+    # Exporting the jump targets found by a translation with OSRA, and using
+    # them as hints for a translation without OSRA, checking that the latter
+    # finds as many jump targets as the former
+    set(JUMP_TARGETS "${BIN}/${TEST_NAME}.jts")
+    set(HINTS_REPORT "${BIN}/${TEST_NAME}.hints.json")
+    set(HINTED_REPORT "${BIN}/${TEST_NAME}.hinted.json")
+    add_translation_variant(hinted
+      "--no-osra --jump-targets ${JUMP_TARGETS} --time-report-json ${HINTED_REPORT}"
+      BEFORE "$<TARGET_FILE:revamb> --use-sections -g none --export-jump-targets ${JUMP_TARGETS} --time-report-json ${HINTS_REPORT} --architecture ${ARCH} ${BIN}/${TEST_NAME} ${BIN}/${TEST_NAME}.hints.ll"
+      AFTER "grep '\"jump-targets\":' ${HINTS_REPORT} > ${HINTS_REPORT}.count && grep '\"jump-targets\":' ${HINTED_REPORT} > ${HINTED_REPORT}.count && ${DIFF} ${HINTS_REPORT}.count ${HINTED_REPORT}.count")
+
+    # Saving the state of a translation, and translating the binary again
+    # reusing it
+    set(STATE "${BIN}/${TEST_NAME}.state")
+    add_translation_variant(incremental "--previous-state ${STATE}"
+      BEFORE "$<TARGET_FILE:revamb> --use-sections -g none --save-state ${STATE} --architecture ${ARCH} ${BIN}/${TEST_NAME} ${BIN}/${TEST_NAME}.state.ll")
+
+    # With tracing enabled, to collect an execution profile
+    add_translation_variant(tracing "--tracing" NO_CHECK)
+
+    # Collect the execution profile using the first set of arguments
+    list(GET TEST_RUNS_${TEST_NAME} 0 PROFILE_RUN)
+    add_test(NAME profile-${TEST_NAME}-${ARCH}
+      COMMAND sh -c "REVAMB_PROFILE=${BIN}/${TEST_NAME}.profile ${BIN}/${TEST_NAME}.tracing.translated ${TEST_ARGS_${TEST_NAME}_${PROFILE_RUN}} > /dev/null")
+    set_tests_properties(profile-${TEST_NAME}-${ARCH}
+      PROPERTIES DEPENDS compile-translated-tracing-${TEST_NAME}-${ARCH}
+                 LABELS "profile;${TEST_NAME};${ARCH}")
+
+    # Using the execution profile
+    add_translation_variant(profiled "--profile ${BIN}/${TEST_NAME}.profile"
+      DEPENDS profile-${TEST_NAME}-${ARCH})
+
     # For each set of arguments
     foreach(RUN_NAME ${TEST_RUNS_${TEST_NAME}})
       # Test to run the translated program
@@ -232,7 +480,119 @@ foreach(ARCH ${SUPPORTED_ARCHITECTURES})
         PROPERTIES DEPENDS "${DEPS}"
                    LABELS "check-with-native;${TEST_NAME};${RUN_NAME};${ARCH}")
 
+      # Check the binary trace, once converted, corresponds to the textual one
+      set(TRACE "${BIN}/${TEST_NAME}-${RUN_NAME}.trace")
+      add_test(NAME check-trace-${TEST_NAME}-${RUN_NAME}-${ARCH}
+        COMMAND sh -c "rm -f ${TRACE} && REVAMB_TRACE=${TRACE} ${BIN}/${TEST_NAME}.tracing.translated ${TEST_ARGS_${TEST_NAME}_${RUN_NAME}} > /dev/null && ${CMAKE_BINARY_DIR}/trace-to-text ${TRACE} > ${TRACE}.txt && ${BIN}/${TEST_NAME}.tracing.translated ${TEST_ARGS_${TEST_NAME}_${RUN_NAME}} 2>&1 > /dev/null | ${DIFF} - ${TRACE}.txt")
+      set_tests_properties(check-trace-${TEST_NAME}-${RUN_NAME}-${ARCH}
+        PROPERTIES DEPENDS compile-translated-tracing-${TEST_NAME}-${ARCH}
+                   LABELS "check-trace;${TEST_NAME};${RUN_NAME};${ARCH}")
+
+    endforeach()
+  endforeach()
+
+  # Test to translate the patched version of a program reusing the state
+  # saved translating the original one, and check that some of its jump
+  # targets have been invalidated and some others reused
+  foreach(TEST_NAME ${PATCHED_TESTS})
+    set(PATCHED "${TEST_NAME}_patched")
+    set(REPORT "${BIN}/${PATCHED}.json")
+    add_test(NAME translate-patched-${TEST_NAME}-${ARCH}
+      COMMAND sh -c "$<TARGET_FILE:revamb> --use-sections -g none --previous-state ${BIN}/${TEST_NAME}.state --time-report-json ${REPORT} --architecture ${ARCH} ${BIN}/${PATCHED} ${BIN}/${PATCHED}.ll && grep -q '\"invalidated-jump-targets\": [1-9]' ${REPORT} && grep -q '\"reused-jump-targets\": [1-9]' ${REPORT}")
+    set_tests_properties(translate-patched-${TEST_NAME}-${ARCH}
+      PROPERTIES DEPENDS translate-incremental-${TEST_NAME}-${ARCH}
+                 LABELS "translate-patched;${TEST_NAME};${ARCH}")
+
+    compile_executable("$(${CMAKE_BINARY_DIR}/li-csv-to-ld-options ${BIN}/${PATCHED}.ll.li.csv) ${BIN}/${PATCHED}${CMAKE_C_OUTPUT_EXTENSION} ${CMAKE_BINARY_DIR}/support.c -DTARGET_${NORMALIZED_ARCH} -lz -lm -lrt -Wno-pointer-to-int-cast -Wno-int-to-pointer-cast -g -fno-pie"
+      "${BIN}/${PATCHED}.translated"
+      COMPILE_TRANSLATED_PATCHED)
+
+    # Compile the LLVM IR of the patched program
+    add_test(NAME compile-translated-patched-${TEST_NAME}-${ARCH}
+      COMMAND sh -c "${LLC} -O0 -filetype=obj ${BIN}/${PATCHED}.ll -o ${BIN}/${PATCHED}${CMAKE_C_OUTPUT_EXTENSION} && ${COMPILE_TRANSLATED_PATCHED}")
+    set_tests_properties(compile-translated-patched-${TEST_NAME}-${ARCH}
+      PROPERTIES DEPENDS translate-patched-${TEST_NAME}-${ARCH}
+                 LABELS "compile-translated-patched;${TEST_NAME};${ARCH}")
+
+    # Check the output of the patched program translated reusing the state
+    # corresponds to the qemu-user's one
+    foreach(RUN_NAME ${TEST_RUNS_${TEST_NAME}})
+      set(QEMU_LOG "${BIN}/run-qemu-test-${PATCHED}-${RUN_NAME}.log")
+      add_test(NAME check-patched-with-qemu-${TEST_NAME}-${RUN_NAME}-${ARCH}
+        COMMAND sh -c "${QEMU_${ARCH}} ${BIN}/${PATCHED} ${TEST_ARGS_${TEST_NAME}_${RUN_NAME}} > ${QEMU_LOG} && ${BIN}/${PATCHED}.translated ${TEST_ARGS_${TEST_NAME}_${RUN_NAME}} | ${DIFF} - ${QEMU_LOG}")
+      set_tests_properties(check-patched-with-qemu-${TEST_NAME}-${RUN_NAME}-${ARCH}
+        PROPERTIES DEPENDS compile-translated-patched-${TEST_NAME}-${ARCH}
+                   LABELS "check-patched-with-qemu;${TEST_NAME};${RUN_NAME};${ARCH}")
     endforeach()
   endforeach()
 
+  # Translation benchmarks
+  set(BENCHMARK_INPUTS "${BENCHMARK_BINARIES_${ARCH}}")
+  foreach(BENCHMARK_NAME ${BENCHMARKS})
+    list(APPEND BENCHMARK_INPUTS "${BIN}/${BENCHMARK_NAME}")
+  endforeach()
+
+  # The version in the name of the baseline has to be bumped when the meaning
+  # of one of its columns changes
+  set(BENCHMARK_COMMAND "${CMAKE_SOURCE_DIR}/tests/benchmark-translation"
+    -r "$<TARGET_FILE:revamb>"
+    -a "${ARCH}"
+    -o "${CMAKE_BINARY_DIR}/benchmarks/${ARCH}"
+    -b "${BENCHMARK_BASELINE_DIRECTORY}/translation-${ARCH}-v2.csv"
+    -t "${BENCHMARK_THRESHOLD}")
+
+  add_custom_target(benchmark-translation-${ARCH}
+    COMMAND ${BENCHMARK_COMMAND} ${BENCHMARK_INPUTS}
+    COMMENT "Benchmarking the translation of ${ARCH} binaries"
+    VERBATIM)
+  add_custom_target(benchmark-translation-update-baseline-${ARCH}
+    COMMAND ${BENCHMARK_COMMAND} -u ${BENCHMARK_INPUTS}
+    COMMENT "Updating the translation benchmarks baseline for ${ARCH}"
+    VERBATIM)
+  add_dependencies(benchmark-translation-${ARCH} revamb TEST_PROJECT_${ARCH})
+  add_dependencies(benchmark-translation-update-baseline-${ARCH}
+    revamb TEST_PROJECT_${ARCH})
+  list(APPEND BENCHMARK_TARGETS benchmark-translation-${ARCH})
+  list(APPEND BENCHMARK_UPDATE_TARGETS
+    benchmark-translation-update-baseline-${ARCH})
+
+  # Run-time benchmarks
+  add_custom_target(benchmark-runtime-${ARCH})
+  add_dependencies(benchmark-runtime-${ARCH} revamb TEST_PROJECT_${ARCH})
+  string(REPLACE ";" " " DISPATCHERS "${BENCHMARK_DISPATCHERS}")
+  string(REPLACE ";" " " SHADOW_STACKS "${BENCHMARK_SHADOW_STACKS}")
+  foreach(BENCHMARK_NAME ${RUNTIME_BENCHMARKS})
+    add_custom_command(TARGET benchmark-runtime-${ARCH} POST_BUILD
+      COMMAND "${CMAKE_SOURCE_DIR}/tests/benchmark-runtime"
+        -a "${ARCH}"
+        -q "${QEMU_${ARCH}}"
+        -n "$<TARGET_FILE:benchmark-native-${BENCHMARK_NAME}>"
+        -T "${CMAKE_BINARY_DIR}/translate"
+        -o "${CMAKE_BINARY_DIR}/benchmarks/${ARCH}"
+        -r "${BENCHMARK_RUNTIME_RUNS}"
+        -d "${DISPATCHERS}"
+        -R "${SHADOW_STACKS}"
+        "${BIN}/${BENCHMARK_NAME}" ${BENCHMARK_ARGS_${BENCHMARK_NAME}}
+      COMMENT "Benchmarking ${BENCHMARK_NAME} on ${ARCH}"
+      VERBATIM)
+    add_dependencies(benchmark-runtime-${ARCH}
+      benchmark-native-${BENCHMARK_NAME})
+  endforeach()
+  list(APPEND BENCHMARK_RUNTIME_TARGETS benchmark-runtime-${ARCH})
+
 endforeach()
+
+# Benchmark the translation for all the supported architectures
+add_custom_target(benchmark-translation)
+add_custom_target(benchmark-translation-update-baseline)
+if(BENCHMARK_TARGETS)
+  add_dependencies(benchmark-translation ${BENCHMARK_TARGETS})
+  add_dependencies(benchmark-translation-update-baseline
+    ${BENCHMARK_UPDATE_TARGETS})
+endif()
+
+# Benchmark the translated code for all the supported architectures
+add_custom_target(benchmark-runtime)
+if(BENCHMARK_RUNTIME_TARGETS)
+  add_dependencies(benchmark-runtime ${BENCHMARK_RUNTIME_TARGETS})
+endif()
@@ -0,0 +1,6 @@
+/*
+ * This file is distributed under the MIT License. See LICENSE.md for details.
+ */
+
+#define PATCHED
+#include "calc.c"
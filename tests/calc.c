@@ -7,7 +7,13 @@
 #include <string.h>
 #include <stdint.h>
 
-#define FAILURE 666
+/* The patched version only changes this constant, to test the incremental
+ * retranslation */
+#ifdef PATCHED
+# define FAILURE 667
+#else
+# define FAILURE 666
+#endif
 #define MAX_OPERATIONS 10
 #define MAX_ARGUMENTS 3
 
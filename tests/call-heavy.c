@@ -0,0 +1,90 @@
+/*
+ * This file is distributed under the MIT License. See LICENSE.md for details.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/* Workload dominated by function calls and returns, to measure how quickly
+   the translated code handles returns: deep recursions and many calls to
+   small functions from different call sites */
+
+#define TREE_SIZE 4096
+
+struct node {
+  uint32_t value;
+  int left;
+  int right;
+};
+
+static struct node tree[TREE_SIZE];
+
+static uint32_t random_state = 1;
+
+static uint32_t next_random(void) {
+  random_state = random_state * 1103515245 + 12345;
+  return random_state >> 8;
+}
+
+static __attribute__((noinline)) uint32_t fibonacci(uint32_t n) {
+  if (n < 2)
+    return n;
+  return fibonacci(n - 1) + fibonacci(n - 2);
+}
+
+static __attribute__((noinline)) uint32_t ackermann(uint32_t m, uint32_t n) {
+  if (m == 0)
+    return n + 1;
+  if (n == 0)
+    return ackermann(m - 1, 1);
+  return ackermann(m - 1, ackermann(m, n - 1));
+}
+
+static __attribute__((noinline)) uint32_t mix(uint32_t a, uint32_t b) {
+  return (a ^ (b << 5)) + (b >> 3);
+}
+
+static __attribute__((noinline)) uint32_t visit(int index, unsigned depth) {
+  uint32_t result;
+
+  if (index < 0)
+    return depth;
+
+  result = mix(tree[index].value, depth);
+  result = mix(result, visit(tree[index].left, depth + 1));
+  return mix(result, visit(tree[index].right, depth + 1));
+}
+
+static void build_tree(void) {
+  int i;
+
+  for (i = 0; i < TREE_SIZE; i++) {
+    tree[i].value = next_random();
+    tree[i].left = 2 * i + 1 < TREE_SIZE ? 2 * i + 1 : -1;
+    tree[i].right = 2 * i + 2 < TREE_SIZE ? 2 * i + 2 : -1;
+  }
+}
+
+int root(unsigned iterations) {
+  uint32_t result = 0;
+  unsigned i;
+
+  build_tree();
+
+  for (i = 0; i < iterations; i++) {
+    result ^= fibonacci(18 + i % 4);
+    result ^= ackermann(2, 64 + i % 8);
+    result ^= visit(0, i);
+  }
+
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 0;
+  if (iterations == 0)
+    iterations = 1;
+  printf("%u\n", root(iterations));
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+/*
+ * This file is distributed under the MIT License. See LICENSE.md for details.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* CPU-bound workloads to measure the performance of the translated code */
+
+#define SIEVE_SIZE 65536
+#define MATRIX_SIZE 48
+#define SORT_SIZE 4096
+#define CRC_SIZE 16384
+
+static unsigned char sieve_buffer[SIEVE_SIZE];
+static int32_t matrix_a[MATRIX_SIZE][MATRIX_SIZE];
+static int32_t matrix_b[MATRIX_SIZE][MATRIX_SIZE];
+static int32_t matrix_c[MATRIX_SIZE][MATRIX_SIZE];
+static uint32_t sort_buffer[SORT_SIZE];
+static unsigned char crc_buffer[CRC_SIZE];
+
+static uint32_t random_state = 1;
+
+static uint32_t next_random(void) {
+  random_state = random_state * 1103515245 + 12345;
+  return random_state >> 8;
+}
+
+static uint32_t sieve(void) {
+  uint32_t i, j, count = 0;
+  memset(sieve_buffer, 1, sizeof(sieve_buffer));
+  for (i = 2; i < SIEVE_SIZE; i++) {
+    if (sieve_buffer[i]) {
+      count++;
+      for (j = i * 2; j < SIEVE_SIZE; j += i)
+        sieve_buffer[j] = 0;
+    }
+  }
+  return count;
+}
+
+static uint32_t matrix_multiply(void) {
+  unsigned i, j, k;
+  uint32_t result = 0;
+
+  for (i = 0; i < MATRIX_SIZE; i++) {
+    for (j = 0; j < MATRIX_SIZE; j++) {
+      matrix_a[i][j] = next_random() % 16;
+      matrix_b[i][j] = next_random() % 16;
+    }
+  }
+
+  for (i = 0; i < MATRIX_SIZE; i++) {
+    for (j = 0; j < MATRIX_SIZE; j++) {
+      int32_t sum = 0;
+      for (k = 0; k < MATRIX_SIZE; k++)
+        sum += matrix_a[i][k] * matrix_b[k][j];
+      matrix_c[i][j] = sum;
+      result += sum;
+    }
+  }
+
+  return result;
+}
+
+static int compare(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *) a;
+  uint32_t y = *(const uint32_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+static uint32_t sort(void) {
+  unsigned i;
+  for (i = 0; i < SORT_SIZE; i++)
+    sort_buffer[i] = next_random();
+  qsort(sort_buffer, SORT_SIZE, sizeof(sort_buffer[0]), compare);
+  return sort_buffer[SORT_SIZE / 2];
+}
+
+static uint32_t crc32(void) {
+  unsigned i, j;
+  uint32_t crc = 0xffffffff;
+
+  for (i = 0; i < CRC_SIZE; i++)
+    crc_buffer[i] = next_random();
+
+  for (i = 0; i < CRC_SIZE; i++) {
+    crc ^= crc_buffer[i];
+    for (j = 0; j < 8; j++)
+      crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+  }
+
+  return ~crc;
+}
+
+int root(unsigned iterations) {
+  uint32_t result = 0;
+  unsigned i;
+  for (i = 0; i < iterations; i++)
+    result ^= sieve() + matrix_multiply() + sort() + crc32();
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 0;
+  if (iterations == 0)
+    iterations = 1;
+  printf("%u\n", root(iterations));
+  return EXIT_SUCCESS;
+}
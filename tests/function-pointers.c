@@ -0,0 +1,51 @@
+/*
+ * This file is distributed under the MIT License. See LICENSE.md for details.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Create a large number of functions whose addresses end up in global data */
+
+#define FUNCTION(n) static int function_##n(int x) { return x * (n) + 1; }
+#define FUNCTIONS4(n)                                                   \
+  FUNCTION(n##0) FUNCTION(n##1) FUNCTION(n##2) FUNCTION(n##3)
+#define FUNCTIONS16(n)                                                  \
+  FUNCTIONS4(n##0) FUNCTIONS4(n##1) FUNCTIONS4(n##2) FUNCTIONS4(n##3)
+#define FUNCTIONS64(n)                                                  \
+  FUNCTIONS16(n##0) FUNCTIONS16(n##1) FUNCTIONS16(n##2) FUNCTIONS16(n##3)
+
+#define POINTER(n) function_##n,
+#define POINTERS4(n) POINTER(n##0) POINTER(n##1) POINTER(n##2) POINTER(n##3)
+#define POINTERS16(n)                                                   \
+  POINTERS4(n##0) POINTERS4(n##1) POINTERS4(n##2) POINTERS4(n##3)
+#define POINTERS64(n)                                                   \
+  POINTERS16(n##0) POINTERS16(n##1) POINTERS16(n##2) POINTERS16(n##3)
+
+FUNCTIONS64(1)
+FUNCTIONS64(2)
+FUNCTIONS64(3)
+FUNCTIONS64(4)
+
+typedef int (*function_pointer)(int);
+
+function_pointer table[] = {
+  POINTERS64(1)
+  POINTERS64(2)
+  POINTERS64(3)
+  POINTERS64(4)
+};
+
+int root(char *buffer, size_t size) {
+  int result = 0;
+  unsigned i = 0;
+  for (i = 0; i < sizeof(table) / sizeof(table[0]); i++)
+    result += table[(i * 7 + size) % (sizeof(table) / sizeof(table[0]))](i);
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  printf("%d\n", root(argv[1], strlen(argv[1])));
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,142 @@
+/*
+ * This file is distributed under the MIT License. See LICENSE.md for details.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/* Workload dominated by indirect branches, to measure the performance of the
+   dispatcher of the translated code: a bytecode interpreter whose main loop
+   is a switch (usually compiled to a jump table) and whose instructions call
+   handlers through function pointers */
+
+#define PROGRAM_SIZE 1024
+#define STACK_SIZE 64
+
+enum opcode {
+  OP_PUSH,
+  OP_ADD,
+  OP_SUB,
+  OP_XOR,
+  OP_SHL,
+  OP_SHR,
+  OP_DUP,
+  OP_SWAP,
+  OP_CALL,
+  OP_COUNT
+};
+
+static unsigned char program[PROGRAM_SIZE];
+static uint32_t stack[STACK_SIZE];
+static unsigned top;
+
+static uint32_t random_state = 1;
+
+static uint32_t next_random(void) {
+  random_state = random_state * 1103515245 + 12345;
+  return random_state >> 8;
+}
+
+static void push(uint32_t value) {
+  stack[top++ % STACK_SIZE] = value;
+}
+
+static uint32_t pop(void) {
+  return stack[--top % STACK_SIZE];
+}
+
+static uint32_t handler_rotate(uint32_t value) {
+  return (value << 7) | (value >> 25);
+}
+
+static uint32_t handler_square(uint32_t value) {
+  return value * value;
+}
+
+static uint32_t handler_negate(uint32_t value) {
+  return -value;
+}
+
+static uint32_t handler_mix(uint32_t value) {
+  return value ^ (value >> 13) ^ 0x9e3779b9;
+}
+
+static uint32_t (*handlers[])(uint32_t) = {
+  handler_rotate,
+  handler_square,
+  handler_negate,
+  handler_mix
+};
+
+static uint32_t run(void) {
+  unsigned pc;
+  uint32_t a, b;
+
+  top = 2;
+  stack[0] = 1;
+  stack[1] = 2;
+
+  for (pc = 0; pc < PROGRAM_SIZE; pc++) {
+    switch (program[pc]) {
+    case OP_PUSH:
+      push(pc);
+      break;
+    case OP_ADD:
+      push(pop() + pop());
+      break;
+    case OP_SUB:
+      a = pop();
+      b = pop();
+      push(a - b);
+      break;
+    case OP_XOR:
+      push(pop() ^ pop());
+      break;
+    case OP_SHL:
+      push(pop() << 3);
+      break;
+    case OP_SHR:
+      push(pop() >> 5);
+      break;
+    case OP_DUP:
+      a = pop();
+      push(a);
+      push(a);
+      break;
+    case OP_SWAP:
+      a = pop();
+      b = pop();
+      push(a);
+      push(b);
+      break;
+    case OP_CALL:
+      a = pop();
+      push(handlers[a % 4](a));
+      break;
+    }
+  }
+
+  return pop();
+}
+
+int root(unsigned iterations) {
+  uint32_t result = 0;
+  unsigned i;
+
+  for (i = 0; i < PROGRAM_SIZE; i++)
+    program[i] = next_random() % OP_COUNT;
+
+  for (i = 0; i < iterations; i++)
+    result ^= run();
+
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 0;
+  if (iterations == 0)
+    iterations = 1;
+  printf("%u\n", root(iterations));
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+/// \file timereport.cpp
+/// \brief Collection of the resources used by each phase of the translation.
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <map>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+// Local includes
+#include "timereport.h"
+
+bool TimeReportEnabled = false;
+char PhaseMarkerPass::ID = 0;
+
+/// \brief Aggregated resources used by all the runs of a phase
+struct PhaseRecord {
+  std::string Name;
+  unsigned Count;
+  double WallTime;
+  double CPUTime;
+  long PeakRSS;
+};
+
+static std::vector<PhaseRecord> Phases;
+static std::map<std::string, size_t> PhasesIndex;
+static std::vector<std::pair<std::string, uint64_t>> Counters;
+
+static std::string CurrentPhase;
+static ResourceUsage CurrentPhaseStart;
+
+static double toSeconds(const struct timeval &Time) {
+  return Time.tv_sec + Time.tv_usec / 1000000.0;
+}
+
+ResourceUsage ResourceUsage::now() {
+  using namespace std::chrono;
+  ResourceUsage Result;
+
+  auto SinceEpoch = steady_clock::now().time_since_epoch();
+  Result.WallTime = duration_cast<duration<double>>(SinceEpoch).count();
+
+  struct rusage Usage;
+  getrusage(RUSAGE_SELF, &Usage);
+  Result.CPUTime = toSeconds(Usage.ru_utime) + toSeconds(Usage.ru_stime);
+  Result.PeakRSS = Usage.ru_maxrss;
+
+  return Result;
+}
+
+void recordPhase(const std::string &Name, const ResourceUsage &Start) {
+  ResourceUsage End = ResourceUsage::now();
+
+  auto It = PhasesIndex.find(Name);
+  if (It == PhasesIndex.end()) {
+    It = PhasesIndex.insert({ Name, Phases.size() }).first;
+    Phases.push_back({ Name, 0, 0.0, 0.0, 0 });
+  }
+
+  PhaseRecord &Record = Phases[It->second];
+  Record.Count++;
+  Record.WallTime += End.WallTime - Start.WallTime;
+  Record.CPUTime += End.CPUTime - Start.CPUTime;
+  Record.PeakRSS = std::max(Record.PeakRSS, End.PeakRSS);
+}
+
+void switchPhase(const std::string &Name) {
+  if (!TimeReportEnabled)
+    return;
+
+  if (!CurrentPhase.empty())
+    recordPhase(CurrentPhase, CurrentPhaseStart);
+
+  CurrentPhase = Name;
+  if (!CurrentPhase.empty())
+    CurrentPhaseStart = ResourceUsage::now();
+}
+
+void setCounter(const std::string &Name, uint64_t Value) {
+  for (auto &Counter : Counters) {
+    if (Counter.first == Name) {
+      Counter.second = Value;
+      return;
+    }
+  }
+
+  Counters.push_back({ Name, Value });
+}
+
+void printTimeReport(std::ostream &Output) {
+  Output << std::left << std::setw(40) << "Phase"
+         << std::right << std::setw(8) << "Runs"
+         << std::setw(12) << "Wall (s)"
+         << std::setw(12) << "CPU (s)"
+         << std::setw(16) << "Peak RSS (KiB)"
+         << "\n";
+
+  Output << std::fixed << std::setprecision(3);
+  for (const PhaseRecord &Record : Phases) {
+    Output << std::left << std::setw(40) << Record.Name
+           << std::right << std::setw(8) << Record.Count
+           << std::setw(12) << Record.WallTime
+           << std::setw(12) << Record.CPUTime
+           << std::setw(16) << Record.PeakRSS
+           << "\n";
+  }
+  Output.unsetf(std::ios_base::floatfield);
+
+  for (auto &Counter : Counters)
+    Output << Counter.first << ": " << std::dec << Counter.second << "\n";
+}
+
+void printTimeReportJSON(std::ostream &Output) {
+  Output << "{\n  \"phases\": [";
+
+  const char *Separator = "\n";
+  Output << std::fixed << std::setprecision(6);
+  for (const PhaseRecord &Record : Phases) {
+    Output << Separator
+           << "    { \"name\": \"" << Record.Name << "\""
+           << ", \"runs\": " << Record.Count
+           << ", \"wall\": " << Record.WallTime
+           << ", \"cpu\": " << Record.CPUTime
+           << ", \"peak-rss\": " << Record.PeakRSS
+           << " }";
+    Separator = ",\n";
+  }
+  Output.unsetf(std::ios_base::floatfield);
+
+  Output << "\n  ],\n  \"counters\": {";
+
+  Separator = "\n";
+  for (auto &Counter : Counters) {
+    Output << Separator
+           << "    \"" << Counter.first << "\": " << std::dec << Counter.second;
+    Separator = ",\n";
+  }
+
+  Output << "\n  }\n}\n";
+}
@@ -0,0 +1,91 @@
+#ifndef _TIMEREPORT_H
+#define _TIMEREPORT_H
+
+//
+// This file is distributed under the MIT License. See LICENSE.md for details.
+//
+
+// Standard includes
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// LLVM includes
+#include "llvm/Pass.h"
+
+/// \brief Whether the resources used by each phase should be recorded or not
+extern bool TimeReportEnabled;
+
+/// \brief Snapshot of the resources consumed by the process so far
+struct ResourceUsage {
+  double WallTime; ///< Seconds elapsed since an arbitrary point in time
+  double CPUTime; ///< User and system CPU time, in seconds
+  long PeakRSS; ///< Maximum resident set size, in KiB
+
+  static ResourceUsage now();
+};
+
+/// \brief Record a run of the phase \p Name, started at \p Start
+///
+/// Multiple runs of the same phase are aggregated. Phases are reported in the
+/// order they have been first recorded. By convention, a phase named "a.b" is
+/// part of phase "a".
+void recordPhase(const std::string &Name, const ResourceUsage &Start);
+
+/// \brief Terminate the current phase started by switchPhase, if any, and
+///        start a new one called \p Name, unless it's empty
+void switchPhase(const std::string &Name);
+
+/// \brief Set the value of the counter \p Name, reported along with the phases
+void setCounter(const std::string &Name, uint64_t Value);
+
+/// \brief Print a human readable report of the recorded phases and counters
+void printTimeReport(std::ostream &Output);
+
+/// \brief Print the recorded phases and counters in JSON format
+void printTimeReportJSON(std::ostream &Output);
+
+/// \brief Records the resources used from its construction to its destruction
+class ScopedPhase {
+public:
+  ScopedPhase(std::string Name) :
+    Name(Name), Enabled(TimeReportEnabled), Start() {
+    if (Enabled)
+      Start = ResourceUsage::now();
+  }
+
+  ~ScopedPhase() {
+    if (Enabled)
+      recordPhase(Name, Start);
+  }
+
+private:
+  std::string Name;
+  bool Enabled;
+  ResourceUsage Start;
+};
+
+/// \brief Pass starting a new phase, to time passes from LLVM in a
+///        PassManager
+///
+/// An instance with an empty name terminates the current phase.
+class PhaseMarkerPass : public llvm::FunctionPass {
+public:
+  static char ID;
+
+  PhaseMarkerPass(std::string Name) : llvm::FunctionPass(ID), Name(Name) { }
+
+  bool runOnFunction(llvm::Function &F) override {
+    switchPhase(Name);
+    return false;
+  }
+
+  void getAnalysisUsage(llvm::AnalysisUsage &AU) const override {
+    AU.setPreservesAll();
+  }
+
+private:
+  std::string Name;
+};
+
+#endif // _TIMEREPORT_H
@@ -26,6 +26,7 @@
 // Local includes
 #include "debug.h"
 #include "ir-helpers.h"
+#include "timereport.h"
 #include "variablemanager.h"
 #include "revamb.h"
 #include "ptcdump.h"
@@ -81,6 +82,7 @@ private:
 static const int64_t ErrorOffset = std::numeric_limits<int64_t>::max();
 
 bool CorrectCPUStateUsagePass::runOnModule(Module& TheModule) {
+  ScopedPhase Phase("CorrectCPUStateUsagePass");
   OffsetValueStack WorkList;
 
   Value *CPUStatePtr = TheModule.getGlobalVariable("env");